@@ -9,14 +9,23 @@
 
 /*
  * pin assignment: direct order, aligned to the right of ADC.
- * for dual ADCs it means column X..11, X+12..23
+ * for dual ADCs it means column 0..N-1 on ADC0, N.. on ADC1,
+ * where N is half the columns, rounded up.
  *
- * ODD NUMBER OF COLUMNS DO NOT MIX WITH DUAL ADCs!!! See scan.c!
+ * Odd number of columns with dual ADCs leaves a phantom channel on ADC1 -
+ * MUST BE GROUNDED! See scan_capsense.c!
  */
 #define MATRIX_COLS 16
 #define MATRIX_ROWS 8
 #define MATRIX_LAYERS 4
 
+// Number of ADCs scanning columns in parallel. 2 needs ADC1 in TopDesign.
+// #define NUM_ADCs 2
+
+// High-rate scan, see scan_capsense.c. Needs RowDrive DMA in TopDesign, with
+// FinalBuf and RowDrive DRQs wired to the EoC line.
+// #define COMMONSENSE_100KHZ_MODE
+
 // Switch type: BUCKLING_SPRING or BEAMSPRING
 #define SWITCH_TYPE BUCKLING_SPRING
 
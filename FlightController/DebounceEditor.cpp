@@ -0,0 +1,95 @@
+#include <QLabel>
+#include <QMessageBox>
+#include <QSpinBox>
+
+#include "DebounceEditor.h"
+#include "ui_DebounceEditor.h"
+
+DebounceEditor::DebounceEditor(DeviceConfig *config, QWidget *parent)
+    : QFrame(parent, Qt::Tool), ui(new Ui::DebounceEditor), grid(new QGridLayout()) {
+  ui->setupUi(this);
+  deviceConfig = config;
+  initDisplay();
+  connect(ui->applyButton, SIGNAL(clicked()), this, SLOT(applyDebouncing()));
+  connect(ui->revertButton, SIGNAL(clicked()), this, SLOT(resetDebouncing()));
+}
+
+void DebounceEditor::show(void) {
+  if (deviceConfig->bValid) {
+    updateDisplaySize(deviceConfig->numRows, deviceConfig->numCols);
+    resetDebouncing();
+    QWidget::show();
+    QWidget::raise();
+  } else {
+    QMessageBox::critical(this, "Error", "Matrix not configured - cannot edit");
+  }
+}
+
+DebounceEditor::~DebounceEditor() { delete ui; }
+
+void DebounceEditor::initDisplay() {
+  for (uint8_t i = 1; i <= ABSOLUTE_MAX_COLS; i++) {
+    grid->addWidget(new QLabel(QString("%1").arg(i)), 0, i, 1, 1,
+                    Qt::AlignRight);
+    if (i <= ABSOLUTE_MAX_ROWS) {
+      grid->addWidget(new QLabel(QString("%1").arg(i)), i, 0, 1, 1,
+                      Qt::AlignRight);
+    }
+  }
+  for (uint8_t i = 0; i < ABSOLUTE_MAX_ROWS; i++) {
+    for (uint8_t j = 0; j < ABSOLUTE_MAX_COLS; j++) {
+      QSpinBox *l = new QSpinBox();
+      // 0 - key follows global debouncing steps from Hardware dialog.
+      l->setMaximum(MAX_DEBOUNCING_BUFFER_SIZE);
+      l->setSpecialValueText("-");
+      l->setAlignment(Qt::AlignRight);
+      connect(l, QOverload<int>::of(&QSpinBox::valueChanged),
+          [this, l](int){ paintCell(l); });
+      display[i][j] = l;
+      grid->addWidget(l, i + 1, j + 1, 1, 1);
+    }
+  }
+  ui->Dashboard->setLayout(grid);
+}
+
+void DebounceEditor::updateDisplaySize(uint8_t rows, uint8_t cols) {
+  for (uint8_t i = 1; i <= ABSOLUTE_MAX_COLS; i++) {
+    if (i <= ABSOLUTE_MAX_ROWS)
+      grid->itemAtPosition(i, 0)->widget()->setVisible(i <= rows);
+    grid->itemAtPosition(0, i)->widget()->setVisible(i <= cols);
+  }
+  for (uint8_t i = 0; i < ABSOLUTE_MAX_ROWS; i++) {
+    for (uint8_t j = 0; j < ABSOLUTE_MAX_COLS; j++) {
+      display[i][j]->setVisible((i < rows) & (j < cols));
+    }
+  }
+  adjustSize();
+}
+
+void DebounceEditor::paintCell(QSpinBox *cell) {
+  if (cell->value() == 0) {
+    cell->setStyleSheet("");
+  } else {
+    cell->setStyleSheet("color: black; background-color: #ffff99");
+  }
+}
+
+void DebounceEditor::applyDebouncing() {
+  for (uint8_t i = 0; i < deviceConfig->numRows; i++) {
+    for (uint8_t j = 0; j < deviceConfig->numCols; j++) {
+      deviceConfig->debouncing[i][j] = display[i][j]->value();
+    }
+  }
+}
+
+void DebounceEditor::resetDebouncing() {
+  for (uint8_t i = 0; i < deviceConfig->numRows; i++) {
+    for (uint8_t j = 0; j < deviceConfig->numCols; j++) {
+      display[i][j]->setValue(deviceConfig->debouncing[i][j]);
+      paintCell(display[i][j]);
+    }
+  }
+  qInfo() << "Loaded debouncing map";
+}
+
+void DebounceEditor::on_closeButton_clicked() { this->close(); }
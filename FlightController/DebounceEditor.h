@@ -0,0 +1,35 @@
+#pragma once
+
+#include "DeviceConfig.h"
+#include <QFrame>
+#include <QGridLayout>
+#include <QSpinBox>
+
+namespace Ui {
+class DebounceEditor;
+}
+
+class DebounceEditor : public QFrame {
+  Q_OBJECT
+
+public:
+  explicit DebounceEditor(DeviceConfig *config, QWidget *parent = 0);
+  ~DebounceEditor();
+  void show(void);
+
+public slots:
+  void applyDebouncing(void);
+  void resetDebouncing(void);
+
+private:
+  Ui::DebounceEditor *ui;
+  QGridLayout *grid;
+  QSpinBox *display[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  DeviceConfig *deviceConfig;
+  void initDisplay();
+  void updateDisplaySize(uint8_t, uint8_t);
+  void paintCell(QSpinBox *cell);
+
+private slots:
+  void on_closeButton_clicked(void);
+};
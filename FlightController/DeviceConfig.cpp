@@ -164,19 +164,27 @@ void DeviceConfig::_unpack(void) {
   bNormallyLow = _eeprom.capsenseFlags & (1 << CSF_NL);
   switchType = std::min(_eeprom.switchType, (uint8_t)switchTypeNames_.size());
   memset(thresholds, EMPTY_FLASH_BYTE, sizeof(thresholds));
+  memset(debouncing, 0x00, sizeof(debouncing));
   memset(layouts, 0x00, sizeof(layouts));
   auto caps = getSwitchCapabilities();
   uint8_t tableSize = numRows * numCols;
+  // Version 3 has per-key debouncing table right after thresholds.
+  uint8_t keyTables = (_eeprom.configVersion >= 3) ? 2 : 1;
   for (uint8_t i = 0; i < numRows; i++) {
     for (uint8_t j = 0; j < numCols; j++) {
       uint16_t offset = i * numCols + j;
       this->thresholds[i][j] = caps.hasThresholds ? _eeprom.stash[offset] : 1;
+      if (keyTables > 1) {
+        auto period = _eeprom.stash[tableSize + offset];
+        debouncing[i][j] = period > MAX_DEBOUNCING_BUFFER_SIZE ? 0 : period;
+      }
       for (uint8_t k = 0; k < numLayers; k++) {
-        layouts[k][i][j] = _eeprom.stash[tableSize * (k + 1) + offset];
+        layouts[k][i][j] =
+            _eeprom.stash[tableSize * (k + keyTables) + offset];
       }
     }
   }
-  int macro_start = tableSize * (numLayers + 1);
+  int macro_start = tableSize * (numLayers + keyTables);
   macros.clear();
   while(_eeprom.stash[macro_start] != 0xff) {
     size_t len = _eeprom.stash[macro_start + 2];
@@ -196,9 +204,8 @@ void DeviceConfig::_unpack(void) {
 }
 
 void DeviceConfig::_assemble(void) {
-  _eeprom.configVersion = 2;
+  _eeprom.configVersion = CS_CONFIG_VERSION;
   memset(_eeprom.stash, EMPTY_FLASH_BYTE, sizeof(_eeprom.stash));
-  memset(_eeprom._RESERVED0, EMPTY_FLASH_BYTE, sizeof(_eeprom._RESERVED0));
   memset(_eeprom._RESERVED1, EMPTY_FLASH_BYTE, sizeof(_eeprom._RESERVED1));
   uint8_t tableSize = numRows * numCols;
   auto caps = getSwitchCapabilities();
@@ -208,14 +215,15 @@ void DeviceConfig::_assemble(void) {
       if (caps.hasThresholds) {
         _eeprom.stash[offset] = thresholds[i][j];
       }
+      _eeprom.stash[tableSize + offset] = debouncing[i][j];
       for (uint8_t k = 0; k < numLayers; k++) {
-        this->_eeprom.stash[tableSize * (k + 1) + offset] =
+        this->_eeprom.stash[tableSize * (k + 2) + offset] =
             this->layouts[k][i][j];
       }
     }
   }
 
-  size_t macros_cursor = tableSize * (numLayers + 1);
+  size_t macros_cursor = tableSize * (numLayers + 2);
   for (auto& m : macros) {
     auto bin = m.toBin();
     for (uint8_t i=0; i<bin.length(); i++) {
@@ -323,6 +331,22 @@ HardwareConfig DeviceConfig::getHardwareConfig(void) {
   retval.chargeDelay = _eeprom.chargeDelay;
   retval.dischargeDelay = _eeprom.dischargeDelay;
   retval.debouncingTicks = _eeprom.debouncingTicks;
+  retval.eagerPress = _eeprom.debouncingMode == DEBOUNCING_EAGER_PRESS;
+  // Older configs have 0xff there - firmware treats that as off, so do we.
+  if (_eeprom.governorSteps > MAX_GOVERNOR_STEPS ||
+      _eeprom.governorIdle == 0) {
+    retval.governorIdle = 0;
+    retval.governorSteps = 0;
+  } else {
+    retval.governorIdle = _eeprom.governorIdle;
+    retval.governorSteps = _eeprom.governorSteps;
+  }
+  retval.wakeRows = _eeprom.wakeRows > numRows ? 0 : _eeprom.wakeRows;
+  retval.wakeMargin = _eeprom.wakeMargin;
+  // Firmware uses the default where older configs have 0xff.
+  retval.comboWindow = _eeprom.comboWindow > MAX_COMBO_WINDOW
+                           ? DEFAULT_COMBO_WINDOW
+                           : _eeprom.comboWindow;
   retval.expHdrMode = _eeprom.expMode;
   retval.expHdrParam1 = _eeprom.expParam1;
   retval.expHdrParam2 = _eeprom.expParam2;
@@ -334,6 +358,13 @@ void DeviceConfig::setHardwareConfig(HardwareConfig config) {
   _eeprom.chargeDelay = config.chargeDelay;
   _eeprom.dischargeDelay = config.dischargeDelay;
   _eeprom.debouncingTicks = config.debouncingTicks;
+  _eeprom.debouncingMode =
+      config.eagerPress ? DEBOUNCING_EAGER_PRESS : DEBOUNCING_SYMMETRIC;
+  _eeprom.governorIdle = config.governorIdle;
+  _eeprom.governorSteps = config.governorSteps;
+  _eeprom.wakeRows = config.wakeRows;
+  _eeprom.wakeMargin = config.wakeMargin;
+  _eeprom.comboWindow = config.comboWindow;
   _eeprom.expMode = config.expHdrMode;
   _eeprom.expParam1 = config.expHdrParam1;
   _eeprom.expParam2 = config.expHdrParam2;
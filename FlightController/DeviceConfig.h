@@ -12,6 +12,12 @@ struct HardwareConfig {
   uint8_t chargeDelay;
   uint16_t dischargeDelay;
   uint8_t debouncingTicks;
+  bool eagerPress;
+  uint8_t governorIdle;
+  uint8_t governorSteps;
+  uint8_t wakeRows;
+  uint8_t wakeMargin;
+  uint8_t comboWindow;
   uint8_t expHdrMode;
   uint8_t expHdrParam1;
   uint8_t expHdrParam2;
@@ -42,6 +48,7 @@ public:
   uint8_t numDelays;
   bool bNormallyLow;
   uint8_t thresholds[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  uint8_t debouncing[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
   uint8_t layouts[ABSOLUTE_MAX_LAYERS][ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
   std::vector<Macro> macros;
   std::vector<LayerCondition> loadLayerConditions();
@@ -52,6 +52,36 @@ void DeviceInterface::processStatusReply(QByteArray* payload) {
   if (matrixMonitor) {
     setupMode = false;
   }
+  const uint16_t dropped =
+      (uint8_t)payload->at(6) | ((uint8_t)payload->at(7) << 8);
+  if (dropped > scancodesDropped) {
+    qInfo() << "Device dropped" << dropped - scancodesDropped
+            << "key events - scancode queue was full";
+  }
+  scancodesDropped = dropped;
+  scancodesHighWater = payload->at(8);
+  scancodesCapacity = payload->at(9);
+  const uint8_t configDropped = payload->at(10);
+  if (configDropped && configDropped != configMacrosDropped) {
+    qWarning() << "Device config was converted from version 2 and"
+               << configDropped << "macros at the end didn't fit - re-check"
+               << "macros and save config";
+  }
+  configMacrosDropped = configDropped;
+  const uint16_t usbDropped =
+      (uint8_t)payload->at(11) | ((uint8_t)payload->at(12) << 8);
+  if (usbDropped > usbQueueDropped) {
+    qInfo() << "Device dropped" << usbDropped - usbQueueDropped
+            << "key events - USB queue was full";
+  }
+  usbQueueDropped = usbDropped;
+  const uint16_t macros =
+      (uint8_t)payload->at(13) | ((uint8_t)payload->at(14) << 8);
+  if (macros > macrosDropped) {
+    qInfo() << "Device dropped" << macros - macrosDropped
+            << "macros - all macro players were busy";
+  }
+  macrosDropped = macros;
   emit deviceStatusNotification(StatusUpdated);
   if (!printableStatus) {
     return;
@@ -66,6 +96,49 @@ void DeviceInterface::processStatusReply(QByteArray* payload) {
       << ", insane? " << controllerInsane;
 }
 
+void DeviceInterface::processTelemetryReply(QByteArray* payload) {
+  telemetry_t t;
+  memcpy(&t, payload->constData() + 1, sizeof(t));
+  if (t.cpuHz == 0) {
+    scanTelemetry.clear();
+  } else {
+    auto us = [&](uint8_t isr, uint8_t stat) {
+      return QString::number(1e6 * t.isrCycles[isr][stat] / t.cpuHz, 'f', 1);
+    };
+    scanTelemetry = QString("%1 scans/s, ").arg(t.passesPerSecond);
+    // No EoC ISR in high-rate mode - rows are driven by DMA.
+    if (t.isrCycles[TELEMETRY_ISR_EOC][TELEMETRY_MAX]) {
+      scanTelemetry += QString("EoC %1/%2/%3 µs, ")
+                           .arg(us(TELEMETRY_ISR_EOC, TELEMETRY_MIN))
+                           .arg(us(TELEMETRY_ISR_EOC, TELEMETRY_AVG))
+                           .arg(us(TELEMETRY_ISR_EOC, TELEMETRY_MAX));
+    }
+    scanTelemetry += QString("Result %1/%2/%3 µs, load %4% ")
+                         .arg(us(TELEMETRY_ISR_RESULT, TELEMETRY_MIN))
+                         .arg(us(TELEMETRY_ISR_RESULT, TELEMETRY_AVG))
+                         .arg(us(TELEMETRY_ISR_RESULT, TELEMETRY_MAX))
+                         .arg(t.mainLoopLoad / 10.0, 0, 'f', 1);
+    if (t.scanRows) {
+      scanTelemetry +=
+          QString("(%1x%2 scanned) ").arg(t.scanRows).arg(t.scanColumns);
+    }
+    if (t.scanSlowdown) {
+      scanTelemetry += QString("(idle, gap x%1) ").arg(1 << t.scanSlowdown);
+    }
+    if (scancodesCapacity) {
+      scanTelemetry += QString("queue %1/%2, %3 dropped ")
+                           .arg(scancodesHighWater)
+                           .arg(scancodesCapacity)
+                           .arg(scancodesDropped);
+      scanTelemetry +=
+          QString("USB queue %1 dropped, %2 macros dropped ")
+              .arg(usbQueueDropped)
+              .arg(macrosDropped);
+    }
+  }
+  emit deviceStatusNotification(StatusUpdated);
+}
+
 /**
  * This is the handler of last resort for messages from device.
  * Other modules are supposed to install the event filter and process messages
@@ -77,9 +150,18 @@ bool DeviceInterface::event(QEvent *e) {
     switch (payload->at(0)) {
     case C2RESPONSE_MATRIX_ROW:
         return true; // We are not interested in this, but it has >1 subscribers
+    case C2RESPONSE_KEY_STATS:
+        return true; // Key stats window wasn't there to take it
+    case C2RESPONSE_CAPTURE:
+        return true; // Same for key capture
+    case C2RESPONSE_LATENCY:
+        return true; // Same for latency histograms
     case C2RESPONSE_STATUS:
       processStatusReply(payload);
       return true;
+    case C2RESPONSE_TELEMETRY:
+      processTelemetryReply(payload);
+      return true;
     case C2RESPONSE_SCANCODE:
       if (!config->bValid) {
         return true;
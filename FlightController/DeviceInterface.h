@@ -59,6 +59,17 @@ public:
   QString firmwareVersion{};
   QString dieTemp{};
   QString latencyMs{};
+  QString scanTelemetry{};
+  // Scancode ring stats from status reply. Capacity is 0 for old firmware.
+  uint16_t scancodesDropped{0};
+  uint8_t scancodesHighWater{0};
+  uint8_t scancodesCapacity{0};
+  // Key events the full USB queue dropped.
+  uint16_t usbQueueDropped{0};
+  // Macros not played - all players were busy.
+  uint16_t macrosDropped{0};
+  // Macros lost converting version 2 config, reported once.
+  uint8_t configMacrosDropped{0};
 
 public slots:
   void sendCommand(c2command, uint8_t *);
@@ -96,6 +107,7 @@ private:
   std::atomic<bool> releaseDevice_ {false};
 
   void processStatusReply(QByteArray* payload);
+  void processTelemetryReply(QByteArray* payload);
   hid_device *acquireDevice(void);
   void _initDevice(void);
   void _enqueueCommand(OUT_c2packet_t outbox);
@@ -45,6 +45,12 @@ FlightController::FlightController(QWidget *parent)
       thresholdEditor,
       SLOT(receiveScancode(uint8_t, uint8_t, DeviceInterface::KeyStatus)));
 
+  debounceEditor = new DebounceEditor(di.config);
+
+  keyStats = new KeyStats(di.config);
+
+  keyCapture = new KeyCapture(di.config);
+
   macroEditor = new MacroEditor(di.config);
 
   layerConditions = new LayerConditions(di.config);
@@ -82,6 +88,19 @@ void FlightController::setup(void) {
   connect(ui->action_Thresholds, SIGNAL(triggered()), this,
           SLOT(editThresholdsClick()));
 
+  connect(ui->debouncingButton, SIGNAL(clicked()), this,
+          SLOT(editDebouncingClick()));
+  connect(ui->action_Debouncing, SIGNAL(triggered()), this,
+          SLOT(editDebouncingClick()));
+
+  connect(ui->keyStatsButton, SIGNAL(clicked()), this, SLOT(showKeyStats()));
+  connect(ui->action_Key_stats, SIGNAL(triggered()), this,
+          SLOT(showKeyStats()));
+
+  connect(ui->captureButton, SIGNAL(clicked()), this, SLOT(showKeyCapture()));
+  connect(ui->action_Capture, SIGNAL(triggered()), this,
+          SLOT(showKeyCapture()));
+
   connect(ui->layerModsButton, SIGNAL(clicked()), this,
           SLOT(showLayerConditions()));
   connect(ui->action_Layer_mods, SIGNAL(triggered()), this,
@@ -159,6 +178,7 @@ void FlightController::timerEvent(QTimerEvent * timer) {
 void FlightController::updateStatus(void) {
   DeviceInterface &di = Singleton<DeviceInterface>::instance();
   ui->fwVersionLabel->setText(di.firmwareVersion);
+  ui->telemetryLabel->setText(di.scanTelemetry);
   ui->tempGauge->setText(di.dieTemp);
   if (di.scanEnabled) {
     ui->scanButton
@@ -260,6 +280,9 @@ void FlightController::lockUI(bool lock) {
   ui->statusRequestButton->setDisabled(lock);
   ui->MatrixMonitorButton->setDisabled(lock);
   ui->thresholdsButton->setDisabled(lock);
+  ui->debouncingButton->setDisabled(lock);
+  ui->keyStatsButton->setDisabled(lock);
+  ui->captureButton->setDisabled(lock);
   ui->macrosButton->setDisabled(lock);
   ui->layoutButton->setDisabled(lock);
   ui->layerModsButton->setDisabled(lock);
@@ -274,6 +297,7 @@ void FlightController::lockUI(bool lock) {
   }
   if (!caps.hasMatrixMonitor) {
     ui->MatrixMonitorButton->setDisabled(true);
+    ui->captureButton->setDisabled(true);
   }
 }
 
@@ -286,6 +310,12 @@ void FlightController::editMacrosClick(void) { macroEditor->show(); }
 
 void FlightController::editThresholdsClick(void) { thresholdEditor->show(); }
 
+void FlightController::editDebouncingClick(void) { debounceEditor->show(); }
+
+void FlightController::showKeyStats(void) { keyStats->show(); }
+
+void FlightController::showKeyCapture(void) { keyCapture->show(); }
+
 void FlightController::showLayerConditions(void) {
   layerConditions->show();
   layerConditions->raise();
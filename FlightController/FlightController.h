@@ -18,6 +18,9 @@
 #include "LayoutEditor.h"
 #include "MatrixMonitor.h"
 #include "ThresholdEditor.h"
+#include "DebounceEditor.h"
+#include "KeyStats.h"
+#include "KeyCapture.h"
 #include "MacroEditor.h"
 
 namespace Ui {
@@ -47,6 +50,9 @@ public slots:
   void editLayoutClick(void);
   void editMacrosClick(void);
   void editThresholdsClick(void);
+  void editDebouncingClick(void);
+  void showKeyStats(void);
+  void showKeyCapture(void);
   void showLayerConditions(void);
   void deviceStatusNotification(DeviceInterface::DeviceStatus);
 
@@ -58,6 +64,9 @@ private:
   MatrixMonitor *matrixMonitor;
   LayoutEditor *layoutEditor;
   ThresholdEditor *thresholdEditor;
+  DebounceEditor *debounceEditor;
+  KeyStats *keyStats;
+  KeyCapture *keyCapture;
   MacroEditor *macroEditor;
   LayerConditions *layerConditions;
   Delays *_delays;
@@ -37,6 +37,9 @@ SOURCES += main.cpp \
     LayoutEditor.cpp \
     ScancodeList.cpp \
     ThresholdEditor.cpp \
+    DebounceEditor.cpp \
+    KeyStats.cpp \
+    KeyCapture.cpp \
     MacroEditor.cpp \
     DeviceConfig.cpp \
     LayerConditions.cpp \
@@ -61,6 +64,9 @@ HEADERS  += \
     LayoutEditor.h \
     ScancodeList.h \
     ThresholdEditor.h \
+    DebounceEditor.h \
+    KeyStats.h \
+    KeyCapture.h \
     MacroEditor.h \
     DeviceConfig.h \
     LayerConditions.h \
@@ -78,6 +84,9 @@ FORMS    += \
     MatrixMonitor.ui \
     LayoutEditor.ui \
     ThresholdEditor.ui \
+    DebounceEditor.ui \
+    KeyStats.ui \
+    KeyCapture.ui \
     MacroEditor.ui \
     Hardware.ui \
     DeviceSelector.ui
@@ -30,11 +30,22 @@ void Hardware::init() {
   ui->chargeDelay->setValue(config.chargeDelay);
   ui->dischargeDelay->setValue(config.dischargeDelay);
   ui->debouncingTicks->setValue(config.debouncingTicks);
+  ui->eagerPress->setChecked(config.eagerPress);
+  ui->governorIdle->setValue(config.governorIdle ? config.governorIdle : 60);
+  ui->governorSteps->setValue(config.governorSteps);
+  ui->wakeRows->setMaximum(_config->numRows);
+  ui->wakeRows->setValue(config.wakeRows);
+  ui->wakeMargin->setValue(config.wakeMargin);
+  ui->comboWindow->setValue(config.comboWindow);
 
   auto caps = _config->getSwitchCapabilities();
   ui->adcBits->setEnabled(caps.hasMatrixMonitor);
   ui->chargeDelay->setEnabled(caps.hasDelays);
   ui->dischargeDelay->setEnabled(caps.hasDelays);
+  ui->governorIdle->setEnabled(caps.hasDelays);
+  ui->governorSteps->setEnabled(caps.hasDelays);
+  ui->wakeRows->setEnabled(caps.hasMatrixMonitor);
+  ui->wakeMargin->setEnabled(caps.hasMatrixMonitor);
 
   ui->modeBox->setCurrentIndex(config.expHdrMode);
   ui->Param1->setValue(config.expHdrParam1);
@@ -57,6 +68,12 @@ void Hardware::on_applyButton_clicked(void) {
   config.chargeDelay = ui->chargeDelay->value();
   config.dischargeDelay = ui->dischargeDelay->value();
   config.debouncingTicks = ui->debouncingTicks->value();
+  config.eagerPress = ui->eagerPress->isChecked();
+  config.governorSteps = ui->governorSteps->value();
+  config.governorIdle = config.governorSteps ? ui->governorIdle->value() : 0;
+  config.wakeRows = ui->wakeRows->value();
+  config.wakeMargin = ui->wakeMargin->value();
+  config.comboWindow = ui->comboWindow->value();
   config.expHdrMode = ui->modeBox->currentIndex();
   config.expHdrParam1 = ui->Param1->value();
   config.expHdrParam2 = ui->Param2->value();
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <stdint.h>
+
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QPainter>
+#include <QTextStream>
+#include <QVBoxLayout>
+
+#include "DeviceInterface.h"
+#include "Events.h"
+#include "KeyCapture.h"
+#include "settings.h"
+#include "singleton.h"
+#include "ui_KeyCapture.h"
+
+CapturePlot::CapturePlot(QWidget *parent)
+    : QWidget(parent), trigger(-1), level(-1) {
+  setMinimumSize(512, 200);
+  setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+}
+
+void CapturePlot::setCapture(const QVector<uint16_t> &s, int t, int l) {
+  samples = s;
+  trigger = t;
+  level = l;
+  update();
+}
+
+void CapturePlot::paintEvent(QPaintEvent *) {
+  QPainter p(this);
+  p.fillRect(rect(), Qt::black);
+  if (samples.size() < 2) {
+    return;
+  }
+  // Vertical scale fits samples and trigger level, with a bit of headroom.
+  int lo = *std::min_element(samples.begin(), samples.end());
+  int hi = *std::max_element(samples.begin(), samples.end());
+  lo = std::min(lo, level);
+  hi = std::max(hi, level);
+  const int span = std::max(hi - lo, 1) * 11 / 10;
+  lo -= (span - (hi - lo)) / 2;
+  const qreal xStep = (qreal)(width() - 1) / (samples.size() - 1);
+  auto y = [&](int v) { return height() - 1 - (qreal)(v - lo) * (height() - 1) / span; };
+
+  p.setPen(QPen(Qt::darkYellow, 1, Qt::DashLine));
+  p.drawLine(QPointF(0, y(level)), QPointF(width(), y(level)));
+  if (trigger >= 0) {
+    p.setPen(QPen(Qt::darkRed, 1, Qt::DashLine));
+    p.drawLine(QPointF(trigger * xStep, 0), QPointF(trigger * xStep, height()));
+  }
+  QPolygonF trace;
+  for (int i = 0; i < samples.size(); i++) {
+    trace << QPointF(i * xStep, y(samples[i]));
+  }
+  p.setPen(QPen(Qt::green, 1));
+  p.drawPolyline(trace);
+  p.setPen(Qt::gray);
+  p.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignTop | Qt::AlignLeft,
+             QString("%1").arg(hi));
+  p.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignBottom | Qt::AlignLeft,
+             QString("%1").arg(lo));
+}
+
+KeyCapture::KeyCapture(DeviceConfig *config, QWidget *parent)
+    : QFrame(parent, Qt::Tool), ui(new Ui::KeyCapture), capturedKey(0),
+      trigger(-1), received(0) {
+  ui->setupUi(this);
+  deviceConfig = config;
+  plot = new CapturePlot();
+  QVBoxLayout *l = new QVBoxLayout;
+  l->setContentsMargins(0, 0, 0, 0);
+  l->addWidget(plot);
+  ui->Plot->setLayout(l);
+  auto& di = Singleton<DeviceInterface>::instance();
+  connect(this, SIGNAL(sendCommand(c2command, uint8_t *)), &di,
+          SLOT(sendCommand(c2command, uint8_t *)));
+  di.installEventFilter(this);
+}
+
+KeyCapture::~KeyCapture() { delete ui; }
+
+void KeyCapture::show(void) {
+  if (deviceConfig->bValid) {
+    ui->rowBox->setMaximum(deviceConfig->numRows);
+    ui->colBox->setMaximum(deviceConfig->numCols);
+    QWidget::show();
+    QWidget::raise();
+  } else {
+    QMessageBox::critical(this, "Error",
+                          "Matrix not configured - cannot capture");
+  }
+}
+
+// Trigger level follows the key threshold until changed by hand.
+void KeyCapture::on_rowBox_valueChanged(int) {
+  ui->levelBox->setValue(
+      deviceConfig->thresholds[ui->rowBox->value() - 1][ui->colBox->value() - 1]);
+}
+
+void KeyCapture::on_colBox_valueChanged(int v) { on_rowBox_valueChanged(v); }
+
+void KeyCapture::on_armButton_clicked() {
+  uint8_t msg[63] = {0};
+  const uint16_t level = ui->levelBox->value();
+  msg[0] = (ui->rowBox->value() - 1) * deviceConfig->numCols +
+           ui->colBox->value() - 1;
+  msg[1] = ui->triggerBox->currentIndex(); // Same order as captureTrigger.
+  msg[2] = level & 0xff;
+  msg[3] = level >> 8;
+  received = 0;
+  ui->statusLabel->setText("Armed, waiting for trigger");
+  emit sendCommand(C2CMD_CAPTURE_KEY, msg);
+}
+
+bool KeyCapture::eventFilter(QObject *obj __attribute__((unused)),
+                             QEvent *event) {
+  if (event->type() != DeviceMessage::ET) {
+    return false;
+  }
+  QByteArray *pl = static_cast<DeviceMessage *>(event)->getPayload();
+  if (pl->at(0) != C2RESPONSE_CAPTURE) {
+    return false;
+  }
+  receiveCapture(reinterpret_cast<const uint8_t *>(pl->constData()));
+  return true;
+}
+
+void KeyCapture::receiveCapture(const uint8_t *pl) {
+  const uint8_t count = pl[2];
+  const uint16_t offset = pl[3] | (pl[4] << 8);
+  const uint16_t total = pl[5] | (pl[6] << 8);
+  if (offset == 0) {
+    capturedKey = pl[1];
+    trigger = pl[7] | (pl[8] << 8);
+    samples.fill(0, total);
+    received = 0;
+  }
+  if (samples.size() != total || offset + count > total) {
+    return; // Missed the start - wait for the next capture.
+  }
+  const uint8_t *in = pl + 1 + CAPTURE_HEADER_SIZE;
+  for (uint8_t i = 0; i < count; i++, in += 2) {
+    samples[offset + i] = in[0] | (in[1] << 8);
+  }
+  received += count;
+  ui->statusLabel->setText(
+      QString("Received %1 of %2 samples").arg(received).arg(total));
+  if (received == total) {
+    plot->setCapture(samples, trigger, ui->levelBox->value());
+    ui->statusLabel->setText(QString("r%1 c%2, %3 samples")
+                                 .arg(capturedKey / deviceConfig->numCols + 1)
+                                 .arg(capturedKey % deviceConfig->numCols + 1)
+                                 .arg(total));
+  }
+}
+
+void KeyCapture::on_exportButton_clicked(void) {
+  if (samples.isEmpty() || received != samples.size()) {
+    QMessageBox::information(this, "Nothing to export", "No capture yet");
+    return;
+  }
+  QSettings settings;
+  QFileDialog fd(Q_NULLPTR, "Choose one file to export to");
+  fd.setDirectory(settings.value(SETTINGS_DIR_KEY).toString());
+  fd.setNameFilter(tr("Key capture(*.csv)"));
+  fd.setDefaultSuffix(QString("csv"));
+  fd.setAcceptMode(QFileDialog::AcceptSave);
+  if (fd.exec()) {
+    QStringList fns = fd.selectedFiles();
+    QFile f(fns.at(0));
+    f.open(QIODevice::WriteOnly);
+    QTextStream ts(&f);
+    const int row = capturedKey / deviceConfig->numCols;
+    const int col = capturedKey % deviceConfig->numCols;
+    ts << "Row,Col,Sample,Value,Trigger\n";
+    ts.setIntegerBase(10);
+    for (int i = 0; i < samples.size(); i++) {
+      ts << row << "," << col << "," << i - trigger << "," << samples[i] << ","
+         << (i == trigger ? 1 : 0) << "\n";
+    }
+    f.close();
+  }
+}
+
+void KeyCapture::on_closeButton_clicked() { this->close(); }
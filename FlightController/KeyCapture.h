@@ -0,0 +1,61 @@
+#pragma once
+
+#include "DeviceConfig.h"
+#include "DeviceInterface.h"
+#include "Events.h"
+#include <QFrame>
+#include <QVector>
+#include <QWidget>
+#include <stdint.h>
+
+namespace Ui {
+class KeyCapture;
+}
+
+// Draws captured samples, trigger point and trigger level.
+class CapturePlot : public QWidget {
+public:
+  explicit CapturePlot(QWidget *parent = 0);
+  void setCapture(const QVector<uint16_t> &samples, int trigger, int level);
+
+protected:
+  void paintEvent(QPaintEvent *);
+
+private:
+  QVector<uint16_t> samples;
+  int trigger;
+  int level;
+};
+
+class KeyCapture : public QFrame {
+  Q_OBJECT
+
+public:
+  explicit KeyCapture(DeviceConfig *config, QWidget *parent = 0);
+  ~KeyCapture();
+  void show(void);
+
+signals:
+  void sendCommand(c2command, uint8_t *);
+
+protected:
+  bool eventFilter(QObject *obj, QEvent *event);
+
+private:
+  Ui::KeyCapture *ui;
+  CapturePlot *plot;
+  DeviceConfig *deviceConfig;
+  QVector<uint16_t> samples;
+  uint8_t capturedKey;
+  int trigger;
+  int received;
+
+  void receiveCapture(const uint8_t *pl);
+
+private slots:
+  void on_armButton_clicked(void);
+  void on_exportButton_clicked(void);
+  void on_closeButton_clicked(void);
+  void on_rowBox_valueChanged(int);
+  void on_colBox_valueChanged(int);
+};
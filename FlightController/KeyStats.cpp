@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cstring>
+
+#include <QLabel>
+#include <QMessageBox>
+
+#include "DeviceInterface.h"
+#include "Events.h"
+#include "KeyStats.h"
+#include "singleton.h"
+#include "ui_KeyStats.h"
+
+// Firmware sends this for keys that were never released.
+static const uint8_t kNeverPressed = 0xff;
+// Heatmap goes full red at this many bounces.
+static const uint8_t kHotBounces = 32;
+// Worth a look above this many bounces.
+static const uint8_t kNoisyBounces = 8;
+// No human finger holds a key for less than that, ms.
+static const uint8_t kShortPressMs = 10;
+
+KeyStats::KeyStats(DeviceConfig *config, QWidget *parent)
+    : QFrame(parent, Qt::Tool), ui(new Ui::KeyStats), grid(new QGridLayout()) {
+  ui->setupUi(this);
+  deviceConfig = config;
+  memset(bounces, 0, sizeof(bounces));
+  memset(minPress, kNeverPressed, sizeof(minPress));
+  initDisplay();
+  auto& di = Singleton<DeviceInterface>::instance();
+  connect(this, SIGNAL(sendCommand(c2command, uint8_t)), &di,
+          SLOT(sendCommand(c2command, uint8_t)));
+  di.installEventFilter(this);
+}
+
+KeyStats::~KeyStats() { delete ui; }
+
+void KeyStats::show(void) {
+  if (deviceConfig->bValid) {
+    updateDisplaySize(deviceConfig->numRows, deviceConfig->numCols);
+    QWidget::show();
+    QWidget::raise();
+    on_refreshButton_clicked();
+  } else {
+    QMessageBox::critical(this, "Error",
+                          "Matrix not configured - no stats to show");
+  }
+}
+
+void KeyStats::initDisplay(void) {
+  grid->setSpacing(1);
+  for (uint8_t i = 1; i <= ABSOLUTE_MAX_COLS; i++) {
+    grid->addWidget(new QLabel(QString("%1").arg(i)), 0, i, 1, 1,
+                    Qt::AlignCenter);
+    if (i <= ABSOLUTE_MAX_ROWS) {
+      grid->addWidget(new QLabel(QString("%1").arg(i)), i, 0, 1, 1,
+                      Qt::AlignRight);
+    }
+  }
+  for (uint8_t i = 0; i < ABSOLUTE_MAX_ROWS; i++) {
+    for (uint8_t j = 0; j < ABSOLUTE_MAX_COLS; j++) {
+      QLabel *l = new QLabel();
+      l->setAlignment(Qt::AlignCenter);
+      l->setMinimumSize(36, 36);
+      display[i][j] = l;
+      grid->addWidget(l, i + 1, j + 1, 1, 1);
+      paintCell(i, j);
+    }
+  }
+  ui->Dashboard->setLayout(grid);
+}
+
+void KeyStats::updateDisplaySize(uint8_t rows, uint8_t cols) {
+  for (uint8_t i = 1; i <= ABSOLUTE_MAX_COLS; i++) {
+    if (i <= ABSOLUTE_MAX_ROWS)
+      grid->itemAtPosition(i, 0)->widget()->setVisible(i <= rows);
+    grid->itemAtPosition(0, i)->widget()->setVisible(i <= cols);
+  }
+  for (uint8_t i = 0; i < ABSOLUTE_MAX_ROWS; i++) {
+    for (uint8_t j = 0; j < ABSOLUTE_MAX_COLS; j++) {
+      display[i][j]->setVisible((i < rows) && (j < cols));
+    }
+  }
+  adjustSize();
+}
+
+/*
+ * Bounce count on top, shortest press in ms below.
+ * White for a quiet key, red for kHotBounces and up.
+ */
+void KeyStats::paintCell(uint8_t row, uint8_t col) {
+  QLabel *cell = display[row][col];
+  const uint8_t b = bounces[row][col];
+  const uint8_t mp = minPress[row][col];
+  cell->setText(QString("%1\n%2")
+                    .arg(b)
+                    .arg(mp == kNeverPressed ? QString("--")
+                                             : QString("%1").arg(mp)));
+  cell->setToolTip(
+      QString("r%1 c%2: %3 bounces, shortest press %4")
+          .arg(row + 1)
+          .arg(col + 1)
+          .arg(b)
+          .arg(mp == kNeverPressed ? QString("n/a")
+                                   : QString("%1 ms").arg(mp)));
+  if (deviceConfig->thresholds[row][col] == K_IGNORE_KEY) {
+    cell->setStyleSheet("background-color: #999999;");
+    return;
+  }
+  const int heat = 255 - 255 * std::min(b, kHotBounces) / kHotBounces;
+  cell->setStyleSheet(QString("color: black; background-color: #ff%1%2;")
+                          .arg(heat, 2, 16, QChar('0'))
+                          .arg(heat, 2, 16, QChar('0')));
+}
+
+/*
+ * Bouncy key wants longer debouncing. Key that both bounces and produces
+ * presses too short to be real is reading noise - threshold is too close
+ * to the idle level.
+ */
+void KeyStats::recommend(void) {
+  const uint8_t globalTicks = deviceConfig->getHardwareConfig().debouncingTicks;
+  const auto caps = deviceConfig->getSwitchCapabilities();
+  QStringList advice;
+  for (uint8_t i = 0; i < deviceConfig->numRows; i++) {
+    for (uint8_t j = 0; j < deviceConfig->numCols; j++) {
+      if (deviceConfig->thresholds[i][j] == K_IGNORE_KEY) {
+        continue;
+      }
+      const QString key = QString("r%1 c%2").arg(i + 1).arg(j + 1);
+      const uint8_t ticks = deviceConfig->debouncing[i][j]
+                                ? deviceConfig->debouncing[i][j]
+                                : globalTicks;
+      const bool shortPresses = minPress[i][j] < kShortPressMs;
+      if (caps.hasThresholds && shortPresses && bounces[i][j] > 0) {
+        advice << QString("%1: shortest press %2 ms - move threshold %3 "
+                          "away from idle level (now %4)")
+                      .arg(key)
+                      .arg(minPress[i][j])
+                      .arg(deviceConfig->bNormallyLow ? "up" : "down")
+                      .arg(deviceConfig->thresholds[i][j]);
+      } else if (bounces[i][j] >= kNoisyBounces) {
+        if (ticks >= MAX_DEBOUNCING_BUFFER_SIZE) {
+          advice << QString("%1: %2 bounces at maximum debouncing - "
+                            "check the switch")
+                        .arg(key)
+                        .arg(bounces[i][j]);
+        } else {
+          advice << QString("%1: %2 bounces - set debouncing to %3 (now %4)")
+                        .arg(key)
+                        .arg(bounces[i][j])
+                        .arg(std::min(ticks + 2, MAX_DEBOUNCING_BUFFER_SIZE))
+                        .arg(ticks);
+        }
+      }
+    }
+  }
+  if (advice.isEmpty()) {
+    advice << "Nothing to tune - type some more and refresh.";
+  }
+  ui->recommendations->setPlainText(advice.join("\n"));
+}
+
+/*
+ * One histogram per packet. Summary line with percentiles, then a bar per
+ * non-empty bucket.
+ */
+void KeyStats::receiveLatency(const uint8_t *p) {
+  static const char *kindNames[LATENCY_KINDS] = {"Press", "Release"};
+  const uint8_t kind = p[1];
+  const uint8_t buckets = std::min<uint8_t>(p[2], LATENCY_BUCKETS);
+  const uint16_t width = p[3] | (p[4] << 8);
+  uint32_t maxUs;
+  memcpy(&maxUs, p + 1 + 4, sizeof(maxUs));
+  if (kind >= LATENCY_KINDS) {
+    return;
+  }
+  uint16_t counts[LATENCY_BUCKETS];
+  memcpy(counts, p + 1 + LATENCY_HEADER_SIZE, buckets * sizeof(counts[0]));
+  uint32_t total = 0;
+  uint16_t peak = 1;
+  for (uint8_t i = 0; i < buckets; i++) {
+    total += counts[i];
+    peak = std::max(peak, counts[i]);
+  }
+  // Upper edge of the bucket where cumulative count reaches the share.
+  auto percentile = [&](uint32_t share) {
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < buckets; i++) {
+      seen += counts[i];
+      if (seen * 100 >= total * share) {
+        return (i + 1) * width;
+      }
+    }
+    return buckets * width;
+  };
+  QStringList lines;
+  if (total == 0) {
+    lines << QString("%1: no events yet").arg(kindNames[kind]);
+  } else {
+    lines << QString("%1: %2 events, 50% under %3 us, 99% under %4 us, "
+                     "max %5 us")
+                 .arg(kindNames[kind])
+                 .arg(total)
+                 .arg(percentile(50))
+                 .arg(percentile(99))
+                 .arg(maxUs);
+    for (uint8_t i = 0; i < buckets; i++) {
+      if (counts[i] == 0) {
+        continue;
+      }
+      const QString range =
+          i == buckets - 1
+              ? QString("%1+").arg(i * width)
+              : QString("%1-%2").arg(i * width).arg((i + 1) * width);
+      lines << QString("%1 us %2 %3")
+                   .arg(range, 10)
+                   .arg(QString(40 * counts[i] / peak, '#'), -40)
+                   .arg(counts[i]);
+    }
+  }
+  latencyText[kind] = lines.join("\n");
+  QStringList all;
+  for (const QString &text : latencyText) {
+    all << text;
+  }
+  ui->latencyView->setPlainText(all.join("\n\n"));
+}
+
+bool KeyStats::eventFilter(QObject *obj __attribute__((unused)),
+                           QEvent *event) {
+  if (event->type() != DeviceMessage::ET) {
+    return false;
+  }
+  QByteArray *pl = static_cast<DeviceMessage *>(event)->getPayload();
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(pl->constData());
+  if (pl->at(0) == C2RESPONSE_LATENCY) {
+    receiveLatency(p);
+    return true;
+  }
+  if (pl->at(0) != C2RESPONSE_KEY_STATS) {
+    return false;
+  }
+  const uint8_t start = p[1];
+  const uint8_t count = p[2];
+  const uint8_t total = p[3];
+  if (!deviceConfig->bValid || deviceConfig->numCols == 0) {
+    return true;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t key = start + i;
+    const uint8_t row = key / deviceConfig->numCols;
+    const uint8_t col = key % deviceConfig->numCols;
+    if (row >= deviceConfig->numRows) {
+      break;
+    }
+    bounces[row][col] = p[4 + i];
+    minPress[row][col] = p[4 + count + i];
+    paintCell(row, col);
+  }
+  if (start + count >= total) {
+    recommend();
+  }
+  return true;
+}
+
+void KeyStats::on_refreshButton_clicked() {
+  emit sendCommand(C2CMD_GET_KEY_STATS, 0);
+  emit sendCommand(C2CMD_GET_LATENCY, 0);
+}
+
+void KeyStats::on_clearButton_clicked() {
+  emit sendCommand(C2CMD_GET_KEY_STATS, 1);
+  emit sendCommand(C2CMD_GET_LATENCY, 1);
+}
+
+void KeyStats::on_closeButton_clicked() { this->close(); }
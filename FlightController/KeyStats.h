@@ -0,0 +1,47 @@
+#pragma once
+
+#include "DeviceConfig.h"
+#include "DeviceInterface.h"
+#include "Events.h"
+#include <QFrame>
+#include <QGridLayout>
+#include <QLabel>
+#include <stdint.h>
+
+namespace Ui {
+class KeyStats;
+}
+
+class KeyStats : public QFrame {
+  Q_OBJECT
+
+public:
+  explicit KeyStats(DeviceConfig *config, QWidget *parent = 0);
+  ~KeyStats();
+  void show(void);
+
+signals:
+  void sendCommand(c2command, uint8_t);
+
+protected:
+  bool eventFilter(QObject *obj, QEvent *event);
+
+private:
+  Ui::KeyStats *ui;
+  QGridLayout *grid;
+  QLabel *display[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  uint8_t bounces[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  uint8_t minPress[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  QString latencyText[LATENCY_KINDS];
+  DeviceConfig *deviceConfig;
+  void initDisplay(void);
+  void updateDisplaySize(uint8_t, uint8_t);
+  void paintCell(uint8_t row, uint8_t col);
+  void recommend(void);
+  void receiveLatency(const uint8_t *p);
+
+private slots:
+  void on_refreshButton_clicked(void);
+  void on_clearButton_clicked(void);
+  void on_closeButton_clicked(void);
+};
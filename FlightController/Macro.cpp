@@ -17,6 +17,8 @@ Macro::Macro(const uint8_t keyCode,
     flags |= MACRO_TYPE_ONKEYUP;
   } else if (triggerEvent == "tap") {
     flags |= MACRO_TYPE_TAP;
+  } else if (triggerEvent == "combo") {
+    flags |= MACRO_TYPE_COMBO;
   } else if (triggerEvent == "press") {
     // Do nothing, it's default
   } else {
@@ -47,6 +49,8 @@ QString Macro::getTriggerEventText() {
     return "release";
   } else if (flags & MACRO_TYPE_TAP) {
     return "tap";
+  } else if (flags & MACRO_TYPE_COMBO) {
+    return "combo";
   } else {
     return "press";
   }
@@ -1,4 +1,9 @@
+#include <cstring>
+
+#include <QCheckBox>
+#include <QHBoxLayout>
 #include <QLabel>
+#include <QLineEdit>
 #include <QMenu>
 #include <QMessageBox>
 #include <QSpinBox>
@@ -11,6 +16,61 @@
 
 namespace {
   const QString kNew{"-new-"};
+  // Step commands, in the order of the command combobox.
+  enum {
+    kSelect, kPress, kRelease, kType, kWait, kText,
+    kPushMods, kPopMods, kRevertMods
+  };
+  // Modifier byte bits, in the order of the checkboxes.
+  const QStringList kModNames{"LC", "LS", "LA", "LG", "RC", "RS", "RA", "RG"};
+  // US layout characters for usage codes from kFirstUsage, no shift and with
+  // shift. \0 - nothing to type there.
+  const uint8_t kFirstUsage = 0x04;
+  const char kPlainChars[] = "abcdefghijklmnopqrstuvwxyz1234567890"
+                             "\n\0\0\t -=[]\\\0;'`,./";
+  const char kShiftedChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ!@#$%^&*()"
+                               "\0\0\0\0\0_+{}|\0:\"~<>?";
+  static_assert(sizeof(kPlainChars) == sizeof(kShiftedChars),
+                "Character tables must match");
+
+  // Text to TypeString characters. Characters with no key are skipped.
+  QByteArray encodeText(const QString &text) {
+    QByteArray retval;
+    for (const QChar &qc : text) {
+      const char c = qc.toLatin1();
+      const char *plain = c ? static_cast<const char *>(memchr(
+                                  kPlainChars, c, sizeof(kPlainChars) - 1))
+                            : nullptr;
+      const char *shifted = c ? static_cast<const char *>(memchr(
+                                    kShiftedChars, c, sizeof(kShiftedChars) - 1))
+                              : nullptr;
+      if (plain) {
+        retval.append(static_cast<char>(kFirstUsage + (plain - kPlainChars)));
+      } else if (shifted) {
+        retval.append(static_cast<char>(
+            (kFirstUsage + (shifted - kShiftedChars)) | MACRO_CHAR_SHIFT));
+      } else {
+        qInfo() << "No key to type" << qc << "- skipped";
+      }
+    }
+    return retval;
+  }
+
+  QString decodeText(const QByteArray &chars) {
+    QString retval;
+    for (auto byte : chars) {
+      const uint8_t c = static_cast<uint8_t>(byte);
+      const uint8_t index = (c & ~MACRO_CHAR_SHIFT) - kFirstUsage;
+      const char *table =
+          (c & MACRO_CHAR_SHIFT) ? kShiftedChars : kPlainChars;
+      if (index < sizeof(kPlainChars) - 1 && table[index]) {
+        retval.append(table[index]);
+      } else {
+        qInfo() << "Can't show TypeString character" << c;
+      }
+    }
+    return retval;
+  }
 }
 
 MacroEditor::MacroEditor(DeviceConfig *config, QWidget *parent)
@@ -66,24 +126,53 @@ void MacroEditor::populateSteps(QByteArray &bytes) {
     delay->setCurrentIndex((curByte >> 2) & 0x0f);
     switch (curByte >> 6) {
       case 0: // type
-        cmd->setCurrentIndex(3);
+        cmd->setCurrentIndex(kType);
         sc->setCurrentIndex(static_cast<uint8_t>(bytes[++mptr]));
         break;
       case 1: // press or release
         if (bytes[mptr] & 0x02) {
           // key up
-          cmd->setCurrentIndex(2);
+          cmd->setCurrentIndex(kRelease);
         } else {
           // key down
-          cmd->setCurrentIndex(1);
+          cmd->setCurrentIndex(kPress);
         }
         sc->setCurrentIndex(static_cast<uint8_t>(bytes[++mptr]));
         break;
-      case 2:
-        qInfo() << "WTF unsupported macro command";
+      case 2: // mods stack
+        switch (curByte & 0x03) {
+          case MACRO_MODS_PUSH: {
+            cmd->setCurrentIndex(kPushMods);
+            auto mods = static_cast<uint8_t>(bytes[++mptr]);
+            auto checks = ui->bodyTable->cellWidget(row, 2)
+                              ->findChildren<QCheckBox *>();
+            for (int i = 0; i < checks.size(); i++) {
+              checks[i]->setChecked(mods & (1 << i));
+            }
+            break;
+          }
+          case MACRO_MODS_POP:
+            cmd->setCurrentIndex(kPopMods);
+            break;
+          case MACRO_MODS_REVERT:
+            cmd->setCurrentIndex(kRevertMods);
+            break;
+          default:
+            qInfo() << "WTF unsupported macro command";
+        }
         break;
       case 3: // wait
-        cmd->setCurrentIndex(4);
+        if (curByte & MACRO_WAIT_TYPE_STRING) {
+          // Text. Key column becomes a line edit.
+          cmd->setCurrentIndex(kText);
+          auto len = static_cast<uint8_t>(bytes[++mptr]);
+          auto *text = qobject_cast<QLineEdit *>(
+              ui->bodyTable->cellWidget(row, 2));
+          text->setText(decodeText(bytes.mid(mptr + 1, len)));
+          mptr += len;
+          break;
+        }
+        cmd->setCurrentIndex(kWait);
         break;
     }
     ++mptr;
@@ -101,20 +190,56 @@ QByteArray MacroEditor::encodeSteps(int /* macro_row */) {
     uint8_t commandByte = ((uint8_t)delay->currentIndex() << 2);
     // See firmware sources for explanations on encoding.
     switch (cmd->currentIndex()) {
-      case 0:
+      case kSelect:
         continue;
-      case 1: // press
+      case kPress:
         commandByte |= (0x01 << 6);
         break;
-      case 2: // release
+      case kRelease:
         commandByte |= (0x01 << 6) | 0x02;
         break;
-      case 3: // tap
+      case kType:
         break;
-      case 4: // wait
+      case kWait:
          commandByte |= (0x03 << 6);
          shortCommand = true;
         break;
+      case kText: {
+        // Long text goes in several commands.
+        auto *text =
+            qobject_cast<QLineEdit *>(ui->bodyTable->cellWidget(row, 2));
+        QByteArray chars = encodeText(text->text());
+        commandByte |= (0x03 << 6) | MACRO_WAIT_TYPE_STRING;
+        for (int i = 0; i < chars.size(); i += MACRO_STRING_MAX) {
+          QByteArray chunk = chars.mid(i, MACRO_STRING_MAX);
+          retval.append(commandByte);
+          retval.append(static_cast<char>(chunk.size()));
+          retval.append(chunk);
+        }
+        continue;
+      }
+      case kPushMods: {
+        uint8_t mods = 0;
+        auto checks =
+            ui->bodyTable->cellWidget(row, 2)->findChildren<QCheckBox *>();
+        for (int i = 0; i < checks.size(); i++) {
+          if (checks[i]->isChecked()) {
+            mods |= (1 << i);
+          }
+        }
+        commandByte |= (0x02 << 6) | MACRO_MODS_PUSH;
+        retval.append(commandByte);
+        retval.append(static_cast<char>(mods));
+        continue;
+      }
+      case kPopMods:
+        commandByte |= (0x02 << 6) | MACRO_MODS_POP;
+        shortCommand = true;
+        break;
+      case kRevertMods:
+        commandByte |= (0x02 << 6) | MACRO_MODS_REVERT;
+        shortCommand = true;
+        break;
     }
     retval.append(commandByte);
     if (!shortCommand) {
@@ -124,6 +249,30 @@ QByteArray MacroEditor::encodeSteps(int /* macro_row */) {
   return retval;
 }
 
+// Combo keys are Press steps - it's the keys you press. Nothing else counts.
+QByteArray MacroEditor::encodeCombo() {
+  QByteArray retval;
+  for (int row = 0; row < ui->bodyTable->rowCount() - 1; row++) {
+    auto *cmd = qobject_cast<QComboBox *>(ui->bodyTable->cellWidget(row, 0));
+    auto *sc = qobject_cast<QComboBox *>(ui->bodyTable->cellWidget(row, 2));
+    if (cmd->currentIndex() == kPress) {
+      retval.append(static_cast<char>(sc->currentIndex()));
+    }
+  }
+  return retval;
+}
+
+void MacroEditor::populateCombo(QByteArray &keys) {
+  for (int row = 0; row < keys.size(); row++) {
+    addStep(row);
+    qobject_cast<QComboBox *>(ui->bodyTable->cellWidget(row, 0))
+        ->setCurrentIndex(kPress);
+    qobject_cast<QComboBox *>(ui->bodyTable->cellWidget(row, 2))
+        ->setCurrentIndex(static_cast<uint8_t>(keys[row]));
+  }
+  changed = false;
+}
+
 void MacroEditor::on_macroListCombo_currentIndexChanged(int index) {
   bool existingMacro = (index + 1 != ui->macroListCombo->count());
   if (changed) {
@@ -149,7 +298,11 @@ void MacroEditor::on_macroListCombo_currentIndexChanged(int index) {
     auto& m = deviceConfig->macros[index];
     ui->scanCode->setCurrentIndex(m.keyCode);
     ui->triggerEvent->setCurrentText(m.getTriggerEventText());
-    populateSteps(m.body);
+    if (m.flags & MACRO_TYPE_COMBO) {
+      populateCombo(m.body);
+    } else {
+      populateSteps(m.body);
+    }
   }
   ui->addButton->setEnabled(false);
   ui->deleteButton->setEnabled(existingMacro);
@@ -161,9 +314,26 @@ void MacroEditor::on_addButton_clicked() {
   if (!changed) {
     return;
   }
+  const bool combo = ui->triggerEvent->currentText() == "combo";
+  QByteArray body = combo ? encodeCombo() : encodeSteps(currentMacro);
+  if (combo && (body.size() < 2 || body.size() > MAX_COMBO_KEYS)) {
+    QMessageBox::warning(this, "Error",
+        QString("Combo is %1 keys, must be 2 to %2. Press steps are its keys.")
+            .arg(body.size())
+            .arg(MAX_COMBO_KEYS));
+    ui->addButton->setEnabled(true);
+    return;
+  }
+  if (body.size() > UINT8_MAX) {
+    QMessageBox::warning(this, "Error",
+        QString("Macro is %1 bytes long, can't be over %2.")
+            .arg(body.size())
+            .arg(UINT8_MAX));
+    ui->addButton->setEnabled(true);
+    return;
+  }
   auto newMacro = Macro(ui->scanCode->currentIndex(),
-                        ui->triggerEvent->currentText(),
-                        encodeSteps(currentMacro));
+                        ui->triggerEvent->currentText(), body);
   size_t pos = ui->macroListCombo->currentIndex();
   bool existingMacro = false;
   if (pos < deviceConfig->macros.size()) {
@@ -212,7 +382,8 @@ void MacroEditor::addStepButtonClicked() {
 void MacroEditor::addStep(int row) {
   ui->bodyTable->insertRow(row);
   QComboBox *cmd = new QComboBox();
-  cmd->addItems(QStringList{"-select-", "Press", "Release", "Type", "Wait"});
+  cmd->addItems(QStringList{"-select-", "Press", "Release", "Type", "Wait",
+                            "Text", "Push mods", "Pop mods", "Revert mods"});
   connect(cmd, SIGNAL(currentIndexChanged(int)), SLOT(cmdIndexChanged(int)));
   cmd->setContextMenuPolicy(Qt::CustomContextMenu);
   connect(cmd, SIGNAL(customContextMenuRequested(QPoint)),
@@ -227,13 +398,47 @@ void MacroEditor::addStep(int row) {
   connect(delay, SIGNAL(customContextMenuRequested(QPoint)),
     SLOT(showContextMenu(QPoint)));
   ui->bodyTable->setCellWidget(row, 1, delay);
-  QComboBox *sc = new QComboBox();
-  sc->addItems(ScancodeList().list);
-  connect(sc, SIGNAL(currentIndexChanged(int)), SLOT(userChanged()));
-  sc->setContextMenuPolicy(Qt::CustomContextMenu);
-  connect(sc, SIGNAL(customContextMenuRequested(QPoint)),
+  setKeyWidget(row, kSelect);
+}
+
+// Key column is a key for most commands, a line edit for text and
+// modifier checkboxes for PushMods.
+void MacroEditor::setKeyWidget(int row, int command) {
+  QString kind = "key";
+  if (command == kText) {
+    kind = "text";
+  } else if (command == kPushMods) {
+    kind = "mods";
+  }
+  auto *current = ui->bodyTable->cellWidget(row, 2);
+  if (current && current->objectName() == kind) {
+    return;
+  }
+  QWidget *w;
+  if (command == kText) {
+    QLineEdit *edit = new QLineEdit();
+    connect(edit, SIGNAL(textEdited(QString)), SLOT(userChanged()));
+    w = edit;
+  } else if (command == kPushMods) {
+    w = new QWidget();
+    auto *layout = new QHBoxLayout(w);
+    layout->setContentsMargins(0, 0, 0, 0);
+    for (auto &name : kModNames) {
+      auto *check = new QCheckBox(name);
+      connect(check, SIGNAL(toggled(bool)), SLOT(userChanged()));
+      layout->addWidget(check);
+    }
+  } else {
+    QComboBox *sc = new QComboBox();
+    sc->addItems(ScancodeList().list);
+    connect(sc, SIGNAL(currentIndexChanged(int)), SLOT(userChanged()));
+    w = sc;
+  }
+  w->setObjectName(kind);
+  w->setContextMenuPolicy(Qt::CustomContextMenu);
+  connect(w, SIGNAL(customContextMenuRequested(QPoint)),
     SLOT(showContextMenu(QPoint)));
-  ui->bodyTable->setCellWidget(row, 2, sc);
+  ui->bodyTable->setCellWidget(row, 2, w);
 }
 
 void MacroEditor::showContextMenu(QPoint pt) {
@@ -286,14 +491,17 @@ int MacroEditor::findWidgetRow(QWidget *w) {
 }
 
 void MacroEditor::fillCommandParameters(int row, int command) {
+  setKeyWidget(row, command);
   ui->bodyTable->cellWidget(row, 1)->setEnabled(true);
   ui->bodyTable->cellWidget(row, 2)->setEnabled(true);
   switch (command) {
-    case 0:
+    case kSelect:
       ui->bodyTable->cellWidget(row, 1)->setEnabled(false);
       ui->bodyTable->cellWidget(row, 2)->setEnabled(false);
       break;
-    case 4:
+    case kWait:
+    case kPopMods:
+    case kRevertMods:
       ui->bodyTable->cellWidget(row, 2)->setEnabled(false);
       break;
     default:
@@ -24,7 +24,10 @@ public:
 private:
   QByteArray encodeSteps(int row);
   void populateSteps(QByteArray& bytes);
+  QByteArray encodeCombo();
+  void populateCombo(QByteArray& keys);
   void addStep(int row);
+  void setKeyWidget(int row, int command);
   Ui::MacroEditor *ui;
   DeviceConfig *deviceConfig;
   int currentMacro{0};
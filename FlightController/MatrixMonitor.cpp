@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <climits>
 #include <stdint.h>
 
 #include <QCloseEvent>
@@ -63,7 +64,7 @@ void MatrixMonitor::initDisplay(void) {
       ll->setSpacing(0);
       w->setLayout(ll);
 
-      QLCDNumber *l = new QLCDNumber(3);
+      QLCDNumber *l = new QLCDNumber(4);
       l->setSegmentStyle(QLCDNumber::Filled);
       l->setMinimumHeight(25);
       display[i][j] = l;
@@ -99,60 +100,118 @@ bool MatrixMonitor::eventFilter(QObject *obj __attribute__((unused)),
                                 QEvent *event) {
   if (event->type() == DeviceMessage::ET) {
     QByteArray *pl = static_cast<DeviceMessage *>(event)->getPayload();
-    if (pl->at(0) != C2RESPONSE_MATRIX_ROW)
+    switch (pl->at(0)) {
+    case C2RESPONSE_MATRIX_DELTA:
+      _receiveDelta(reinterpret_cast<const uint8_t *>(pl->constData()));
+      return true;
+    case C2RESPONSE_MATRIX_ROW:
+      break;
+    default:
       return false;
+    }
     if (_warmupRows > 0) {
       _warmupRows--;
       return true;
     }
-    auto& di = Singleton<DeviceInterface>::instance();
     uint8_t row = pl->at(1);
     uint8_t max_cols = pl->at(2);
     for (uint8_t i = 0; i < max_cols; i++) {
-      QLCDNumber *cell = display[row][i];
-      uint8_t level = pl->constData()[3 + i];
-      const auto thr = deviceConfig->thresholds[row][i];
-      if (thr == K_IGNORE_KEY) {
-        cell->setStyleSheet("background-color: #999999;");
-      } else if (di.getStatusBit(deviceStatus::C2DEVSTATUS_INSANE)) {
-        if (level > 0) {
-          cell->setStyleSheet("color: black; background-color: #ff3333;");
-        } else {
-          cell->setStyleSheet("");
-        }
-      } else {
-        if (
-          (deviceConfig->bNormallyLow && level > thr) ||
-          (!deviceConfig->bNormallyLow && level < thr)
-        ) {
-          cell->setStyleSheet("color: black; background-color: #33ff33;");
-        } else {
-          cell->setStyleSheet("");
-        }
-      }
-      _updateStatCell(row, i, level);
-      switch (displayMode) {
-      case DisplayNow:
-        cell->display(cells[row][i].now);
-        break;
-      case DisplayMin:
-        cell->display(cells[row][i].min);
-        break;
-      case DisplayMax:
-        cell->display(cells[row][i].max);
-        break;
-      case DisplayAvg:
-        cell->display((uint8_t)(cells[row][i].sum / cells[row][i].sampleCount));
-        break;
-      default:
-        qCritical() << "Unknown display mode selected!!";
-        close();
-      }
+      _showLevel(row, i, (uint8_t)pl->constData()[3 + i]);
     }
   }
   return false;
 }
 
+/*
+ * Decodes C2RESPONSE_MATRIX_DELTA - see c2_protocol.h.
+ * Every key in the packet is a fresh sample, changed or not.
+ */
+void MatrixMonitor::_receiveDelta(const uint8_t *pl) {
+  const uint8_t width = pl[1];
+  const uint8_t start = pl[2];
+  const uint8_t count = pl[3];
+  const uint8_t *in = pl + 1 + MONITOR_HEADER_SIZE;
+  const uint8_t *end = pl + sizeof(IN_c2packet_t);
+  const uint8_t cols = deviceConfig->numCols;
+  if (cols == 0 || width > 16) {
+    return;
+  }
+  uint32_t acc = 0;
+  uint8_t accBits = 0;
+  auto take = [&](uint8_t n) {
+    while (accBits < n && in < end) {
+      acc |= (uint32_t)*in++ << accBits;
+      accBits += 8;
+    }
+    const uint32_t v = acc & ((1u << n) - 1);
+    acc >>= n;
+    accBits -= std::min(n, accBits);
+    return v;
+  };
+  // Stale packets may come first - decode them, but don't show.
+  const bool warmup = (_warmupRows > 0);
+  if (warmup) {
+    _warmupRows--;
+  }
+  for (uint16_t key = start; key < start + count; key++) {
+    const uint8_t row = key / cols;
+    const uint8_t col = key % cols;
+    if (row >= deviceConfig->numRows) {
+      break;
+    }
+    if (take(1)) {
+      streamLevels[row][col] = take(width);
+    }
+    if (!warmup) {
+      _showLevel(row, col, streamLevels[row][col]);
+    }
+  }
+}
+
+void MatrixMonitor::_showLevel(uint8_t row, uint8_t col, uint16_t level) {
+  auto& di = Singleton<DeviceInterface>::instance();
+  QLCDNumber *cell = display[row][col];
+  const auto thr = deviceConfig->thresholds[row][col];
+  if (thr == K_IGNORE_KEY) {
+    cell->setStyleSheet("background-color: #999999;");
+  } else if (di.getStatusBit(deviceStatus::C2DEVSTATUS_INSANE)) {
+    if (level > 0) {
+      cell->setStyleSheet("color: black; background-color: #ff3333;");
+    } else {
+      cell->setStyleSheet("");
+    }
+  } else {
+    // Thresholds are 8-bit, firmware saturates readouts over 255.
+    const uint8_t compared = std::min<uint16_t>(level, 255);
+    if (
+      (deviceConfig->bNormallyLow && compared > thr) ||
+      (!deviceConfig->bNormallyLow && compared < thr)
+    ) {
+      cell->setStyleSheet("color: black; background-color: #33ff33;");
+    } else {
+      cell->setStyleSheet("");
+    }
+  }
+  _updateStatCell(row, col, level);
+  switch (displayMode) {
+  case DisplayNow:
+    cell->display(cells[row][col].now);
+    break;
+  case DisplayMin:
+    cell->display(cells[row][col].min);
+    break;
+  case DisplayMax:
+    cell->display(cells[row][col].max);
+    break;
+  case DisplayAvg:
+    cell->display((int)(cells[row][col].sum / cells[row][col].sampleCount));
+    break;
+  default:
+    qCritical() << "Unknown display mode selected!!";
+    close();
+  }
+}
+
 void MatrixMonitor::receiveScancode(uint8_t row, uint8_t col,
                                       DeviceInterface::KeyStatus status) {
   if (status == DeviceInterface::KeyPressed) {
@@ -183,7 +242,7 @@ void MatrixMonitor::on_setThresholdsButton_clicked() {
     return;
   for (uint8_t i = 0; i < deviceConfig->numRows; i++) {
     for (uint8_t j = 0; j < deviceConfig->numCols; j++) {
-      deviceConfig->thresholds[i][j] = display[i][j]->intValue();
+      deviceConfig->thresholds[i][j] = std::min(display[i][j]->intValue(), 255);
     }
   }
 }
@@ -212,7 +271,8 @@ void MatrixMonitor::_resetCells() {
   for (uint8_t i = 0; i < ABSOLUTE_MAX_ROWS; i++) {
     for (uint8_t j = 0; j < ABSOLUTE_MAX_COLS; j++) {
       cells[i][j] = {
-          .now = 0, .min = 255, .max = 0, .sum = 0, .sampleCount = 0};
+          .now = 0, .min = 0xffff, .max = 0, .sum = 0, .sampleCount = 0};
+      streamLevels[i][j] = 0;
       _updateStatCellDisplay(i, j);
       display[i][j]->display(0);
     }
@@ -221,7 +281,7 @@ void MatrixMonitor::_resetCells() {
                                    // of first rows.
 }
 
-void MatrixMonitor::_updateStatCell(uint8_t row, uint8_t col, uint8_t level) {
+void MatrixMonitor::_updateStatCell(uint8_t row, uint8_t col, uint16_t level) {
   cells[row][col].now = level;
   cells[row][col].min = std::min(level, cells[row][col].min);
   cells[row][col].max = std::max(level, cells[row][col].max);
@@ -275,3 +335,135 @@ void MatrixMonitor::on_exportButton_clicked(void) {
     f.close();
   }
 }
+
+// Reads file written by on_exportButton_clicked. Keys not in file get no samples.
+bool MatrixMonitor::_loadStats(
+    const QString &fileName,
+    MonitoredCell (&stats)[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS]) {
+  for (uint8_t i = 0; i < ABSOLUTE_MAX_ROWS; i++) {
+    for (uint8_t j = 0; j < ABSOLUTE_MAX_COLS; j++) {
+      stats[i][j] = {.now = 0, .min = 0, .max = 0, .sum = 0, .sampleCount = 0};
+    }
+  }
+  QFile f(fileName);
+  if (!f.open(QIODevice::ReadOnly)) {
+    qInfo() << "Cannot open" << fileName;
+    return false;
+  }
+  QTextStream ts(&f);
+  ts.readLine(); // Header
+  while (!ts.atEnd()) {
+    const QStringList fields = ts.readLine().split(",");
+    if (fields.size() < 7) {
+      continue;
+    }
+    const uint row = fields[0].toUInt();
+    const uint col = fields[1].toUInt();
+    if (row >= ABSOLUTE_MAX_ROWS || col >= ABSOLUTE_MAX_COLS) {
+      continue;
+    }
+    stats[row][col] = {.now = (uint16_t)fields[4].toUInt(),
+                       .min = (uint16_t)fields[2].toUInt(),
+                       .max = (uint16_t)fields[3].toUInt(),
+                       .sum = fields[5].toUInt(),
+                       .sampleCount = fields[6].toUInt()};
+  }
+  return true;
+}
+
+/*
+ * Models firmware wake scan (see scan_capsense.c) on two stats files - one
+ * taken with no keys down, one with every key pressed in turn. Keys driven
+ * together are assumed to add up on the column. For every rows-per-group
+ * setting, worst idle spread is the sum of min-max spreads of the group's
+ * keys - firmware tracks idle minimum, so that's what noise can add on top.
+ * Weakest press is the smallest distance from idle average to pressed level.
+ * Margin in between is recommended, if there's any room.
+ */
+void MatrixMonitor::on_wakeModelButton_clicked(void) {
+  if (!deviceConfig->bValid)
+    return;
+  QSettings settings;
+  const QString dir = settings.value(SETTINGS_DIR_KEY).toString();
+  const QString filter = tr("Matrix stats(*.csv)");
+  const QString restFn = QFileDialog::getOpenFileName(
+      this, "Matrix stats with no keys pressed", dir, filter);
+  if (restFn.isEmpty())
+    return;
+  const QString pressFn = QFileDialog::getOpenFileName(
+      this, "Matrix stats with every key pressed", dir, filter);
+  if (pressFn.isEmpty())
+    return;
+  MonitoredCell rest[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  MonitoredCell press[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
+  if (!_loadStats(restFn, rest) || !_loadStats(pressFn, press))
+    return;
+
+  const auto hw = deviceConfig->getHardwareConfig();
+  const int levelMax = (1 << hw.adcBits) - 1;
+  const bool nl = deviceConfig->bNormallyLow;
+  // Firmware groups scanned rows starting from the last one.
+  std::vector<uint8_t> rows;
+  for (int8_t i = deviceConfig->numRows - 1; i >= 0; i--) {
+    for (uint8_t j = 0; j < deviceConfig->numCols; j++) {
+      if (deviceConfig->thresholds[i][j] != K_IGNORE_KEY) {
+        rows.push_back(i);
+        break;
+      }
+    }
+  }
+  qInfo() << "Wake model:" << restFn << "vs" << pressFn;
+  for (size_t groupRows = 1; groupRows <= rows.size(); groupRows++) {
+    int worstSpread = 0;
+    int weakestPress = INT_MAX;
+    bool saturates = false;
+    for (size_t first = 0; first < rows.size(); first += groupRows) {
+      const size_t last = std::min(first + groupRows, rows.size());
+      for (uint8_t col = 0; col < deviceConfig->numCols; col++) {
+        int spread = 0;
+        int peak = 0;
+        int strongestPress = 0;
+        for (size_t k = first; k < last; k++) {
+          const MonitoredCell &r = rest[rows[k]][col];
+          const MonitoredCell &p = press[rows[k]][col];
+          if (!r.sampleCount) {
+            continue;
+          }
+          spread += r.max - r.min;
+          peak += r.max;
+          if (!p.sampleCount ||
+              deviceConfig->thresholds[rows[k]][col] == K_IGNORE_KEY) {
+            continue;
+          }
+          const int avg = r.sum / r.sampleCount;
+          const int swing = nl ? p.min - avg : avg - p.max;
+          weakestPress = std::min(weakestPress, swing);
+          strongestPress = std::max(strongestPress, nl ? p.max - avg : 0);
+        }
+        worstSpread = std::max(worstSpread, spread);
+        if (peak + strongestPress > levelMax) {
+          saturates = true;
+        }
+      }
+    }
+    QString verdict;
+    if (weakestPress == INT_MAX) {
+      verdict = "no pressed keys in stats";
+    } else if (weakestPress > worstSpread) {
+      const int margin = std::min((worstSpread + weakestPress) / 2, 255);
+      verdict = QString("weakest press %1 - margin %2 recommended")
+                    .arg(weakestPress)
+                    .arg(margin);
+    } else {
+      verdict = QString("weakest press %1 - not separable").arg(weakestPress);
+    }
+    qInfo().noquote() << QString("  %1 rows together%2: idle spread %3, %4%5")
+                   .arg(groupRows)
+                   .arg(groupRows == hw.wakeRows ? " (current)" : "")
+                   .arg(worstSpread)
+                   .arg(verdict)
+                   .arg(saturates ? QString(", saturates %1 bit ADC")
+                                        .arg(hw.adcBits)
+                                  : QString(""));
+  }
+}
@@ -14,9 +14,9 @@ class MatrixMonitor;
 }
 
 typedef struct {
-  uint8_t now;
-  uint8_t min;
-  uint8_t max;
+  uint16_t now;
+  uint16_t min;
+  uint16_t max;
   uint32_t sum;
   uint32_t sampleCount;
 } MonitoredCell;
@@ -53,13 +53,19 @@ private:
   QLabel *statsDisplay[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
   DeviceConfig *deviceConfig;
   uint8_t _warmupRows;
+  // Delta stream decoder state - last value received for every key.
+  uint16_t streamLevels[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS];
 
   void initDisplay(void);
   void updateDisplaySize(uint8_t, uint8_t);
   void enableTelemetry(uint8_t);
   void _resetCells();
-  void _updateStatCell(uint8_t row, uint8_t col, uint8_t level);
+  void _showLevel(uint8_t row, uint8_t col, uint16_t level);
+  void _receiveDelta(const uint8_t *pl);
+  void _updateStatCell(uint8_t row, uint8_t col, uint16_t level);
   void _updateStatCellDisplay(uint8_t row, uint8_t col);
+  bool _loadStats(const QString &fileName,
+                  MonitoredCell (&stats)[ABSOLUTE_MAX_ROWS][ABSOLUTE_MAX_COLS]);
 
 private slots:
   void on_runButton_clicked(void);
@@ -68,4 +74,5 @@ private slots:
   void on_modeBox_currentTextChanged(QString newValue);
   void on_resetButton_clicked(void);
   void on_exportButton_clicked(void);
+  void on_wakeModelButton_clicked(void);
 };
@@ -60,14 +60,83 @@ enum c2command {
   C2CMD_COMMIT,
   C2CMD_ROLLBACK,
   C2CMD_SET_MODE,
-  C2CMD_GET_MATRIX_STATE
+  C2CMD_GET_MATRIX_STATE,
+  C2CMD_GET_KEY_STATS, // payload[0] - clear stats after sending
+  C2CMD_CAPTURE_KEY,   // see below
+  C2CMD_GET_LATENCY    // see below
 };
 
 enum c2response {
-  C2RESPONSE_STATUS = 0x00,
+  C2RESPONSE_STATUS = 0x00, // see below
   C2RESPONSE_CONFIG,
   C2RESPONSE_SCANCODE,
-  C2RESPONSE_MATRIX_ROW
+  C2RESPONSE_MATRIX_ROW,
+  C2RESPONSE_KEY_STATS,
+  C2RESPONSE_MATRIX_DELTA, // see below
+  C2RESPONSE_CAPTURE,      // see below
+  C2RESPONSE_TELEMETRY,    // telemetry_t, follows every C2RESPONSE_STATUS
+  C2RESPONSE_LATENCY       // see below
+};
+
+/*
+ * Latency histograms, C2CMD_GET_LATENCY. payload[0] - clear after sending.
+ * Scanner stamps every debounced edge with the CPU cycle counter, the stamp
+ * travels with the key event to the moment its HID report is loaded into
+ * the USB endpoint. Report counts from the oldest key in it. Macro, tap and
+ * combo output counts from the key that triggered it, but only for events
+ * due when the macro starts - later ones are late on purpose.
+ * Reply is LATENCY_KINDS C2RESPONSE_LATENCY packets: payload[0] -
+ * latencyKind, payload[1] - bucket count, payload[2..3] - bucket width in
+ * us, payload[4..7] - max latency in us, then uint16 counters. All LE.
+ * Last bucket holds everything past it.
+ */
+#define LATENCY_BUCKETS 24
+#define LATENCY_BUCKET_US 125
+#define LATENCY_HEADER_SIZE 8
+
+enum latencyKind {
+  LATENCY_PRESS = 0,
+  LATENCY_RELEASE,
+  LATENCY_KINDS
+};
+
+/*
+ * C2RESPONSE_STATUS. payload[0] - status register, payload[1..2] - firmware
+ * version, payload[3..4] - die temperature sign and value,
+ * payload[5..6] - scancodes dropped since config was applied, LE,
+ * payload[7] - scancode ring high-water mark, payload[8] - ring capacity,
+ * payload[9] - macros that didn't fit when version 2 config was converted,
+ * payload[10..11] - key events dropped from the full USB queue, LE,
+ * payload[12..13] - macros dropped with all players busy, LE.
+ */
+
+/*
+ * Matrix monitor stream, C2RESPONSE_MATRIX_DELTA.
+ * payload[0] - bits per value, payload[1] - first key index,
+ * payload[2] - number of keys in the packet. Then a bitstream, LSB first:
+ * for every key a "changed" bit, followed by the value if it is set.
+ * Values too big for the width saturate, same as readouts compared with
+ * 8-bit thresholds. Unchanged keys keep the value from the previous packets.
+ * Stream restarts with every key marked changed when monitor is enabled and
+ * every MONITOR_KEYFRAME_PASSES passes over the matrix.
+ */
+#define MONITOR_HEADER_SIZE 3
+#define MONITOR_KEYFRAME_PASSES 64
+
+/*
+ * Raw sample capture of a single key, one sample per scan pass.
+ * C2CMD_CAPTURE_KEY: payload[0] - key index, payload[1] - captureTrigger,
+ * payload[2..3] - trigger level, LE. Once the buffer is full device sends it
+ * as C2RESPONSE_CAPTURE: payload[0] - key index, payload[1] - sample count,
+ * payload[2..3] - first sample offset, payload[4..5] - total samples,
+ * payload[6..7] - trigger sample index, then samples, 2 bytes each, LE.
+ */
+#define CAPTURE_HEADER_SIZE 8
+
+enum captureTrigger {
+  CAPTURE_TRIGGER_NOW = 0,
+  CAPTURE_TRIGGER_RISING,
+  CAPTURE_TRIGGER_FALLING
 };
 
 enum deviceStatus {
@@ -83,6 +152,12 @@ enum capsenseFlags {
   CSF_NL = 1,
 };
 
+enum debouncingMode {
+  DEBOUNCING_SYMMETRIC = 0,
+  // Press goes out on the first sample, only release is debounced.
+  DEBOUNCING_EAGER_PRESS,
+};
+
 enum deviceMode {
   C2DEVMODE_NORMAL = 0,
   C2DEVMODE_SETUP,
@@ -105,6 +180,36 @@ enum SwitchType {
   ST_UNKNOWN,
 };
 
+/*
+ * Scanner load for the last second. ISR times are in CPU cycles, cpuHz
+ * converts them. mainLoopLoad is permille of time main loop wasn't asleep.
+ * EoC is all 0 when DMA drives the rows (COMMONSENSE_100KHZ_MODE) - there's
+ * no EoC ISR then.
+ */
+enum telemetryIsr {
+  TELEMETRY_ISR_EOC = 0,
+  TELEMETRY_ISR_RESULT,
+  TELEMETRY_ISRS
+};
+
+enum telemetryStat {
+  TELEMETRY_MIN = 0,
+  TELEMETRY_AVG,
+  TELEMETRY_MAX,
+  TELEMETRY_STATS
+};
+
+typedef struct {
+  uint16_t passesPerSecond;
+  uint16_t mainLoopLoad;
+  uint32_t cpuHz;
+  uint32_t isrCycles[TELEMETRY_ISRS][TELEMETRY_STATS];
+  uint8_t scanSlowdown; // Scan governor step - inter-row gap is 2^step longer.
+  // Rows and columns converted every pass, 0 - scanner doesn't tell.
+  uint8_t scanRows;
+  uint8_t scanColumns;
+} __attribute__((packed)) telemetry_t;
+
 typedef union {
   struct {
     uint8_t status;
@@ -158,6 +263,30 @@ typedef union {
 
 #define MACRO_TYPE_ONKEYUP 0x80
 #define MACRO_TYPE_TAP 0x40
+// Not a macro: 2 to MAX_COMBO_KEYS keycodes of base layer keys that send
+// keyCode when pressed together. See firmware pipeline.c.
+#define MACRO_TYPE_COMBO 0x20
+#define MAX_COMBO_KEYS 4
+
+/*
+ * TypeString macro command: Wait with this flag in the low bits, then length
+ * byte and that many characters. Character is a HID usage code, typed with
+ * shift held if MACRO_CHAR_SHIFT is set. Delay applies to every character.
+ */
+#define MACRO_WAIT_TYPE_STRING 0x01
+#define MACRO_CHAR_SHIFT 0x80
+#define MACRO_STRING_MAX 0xff
+
+/*
+ * Mods stack macro command, operation in the low 2 bits.
+ * PushMods saves modifiers and sets the ones in the byte after it.
+ * PopMods restores saved modifiers, RevertMods does too but keeps them saved.
+ */
+enum macroModsOp {
+  MACRO_MODS_PUSH = 0,
+  MACRO_MODS_POP,
+  MACRO_MODS_REVERT,
+};
 
 #define DELAYS_EVENT 0
 #define DELAYS_TAP 1
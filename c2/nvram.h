@@ -15,7 +15,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define CS_CONFIG_VERSION 2
+#define CS_CONFIG_VERSION 3
 
 #define EEPROM_BYTESIZE 2048
 #define COMMONSENSE_BASE_SIZE 64
@@ -28,6 +28,9 @@
 #endif
 
 #define MAX_DEBOUNCING_BUFFER_SIZE 16
+#define MAX_GOVERNOR_STEPS 8
+#define MAX_COMBO_WINDOW 200
+#define DEFAULT_COMBO_WINDOW 30
 
 typedef union {
   struct {
@@ -43,17 +46,30 @@ typedef union {
     uint8_t chargeDelay;
     uint16_t dischargeDelay;
     uint8_t debouncingTicks;
-    uint8_t _RESERVED0[3];
+    uint8_t debouncingMode;
+    // Scan governor: after governorIdle seconds with no keys down scan
+    // slows down one step, up to governorSteps. Step doubles inter-row gap.
+    // 0 steps - always full rate. Since version 3, was reserved.
+    uint8_t governorIdle;
+    uint8_t governorSteps;
     uint16_t delayLib[NUM_DELAYS]; // 2 bytes per item!
     uint8_t layerConditions[NUM_LAYER_CONDITIONS];
     uint8_t switchType;
-    uint8_t _RESERVED1[7];
+    // Wake scan in USB suspend: rows driven together, 0 - scan full matrix.
+    // Column aggregate must move by more than wakeMargin to wake up.
+    uint8_t wakeRows;
+    uint8_t wakeMargin;
+    // Combo keys wait up to comboWindow ms for the rest, 0 - combos off.
+    uint8_t comboWindow;
+    uint8_t _RESERVED1[4];
 // CONFIG SIZE - count up from here.
 // Storage is for layout-size-specifics and MUST NOT be sized here
 // because firmware can know sizes in advance, while FlightController can't.
 #ifdef MATRIX_ROWS
     // Firmware.
     uint8_t thresholds[COMMONSENSE_MATRIX_SIZE];
+    // Per-key debouncingTicks, 0 - use the global one. Since version 3.
+    uint8_t debouncing[COMMONSENSE_MATRIX_SIZE];
     uint8_t layers[MATRIX_LAYERS][COMMONSENSE_MATRIX_SIZE];
     uint8_t macros[EEPROM_BYTESIZE - COMMONSENSE_CONFIG_SIZE -
                    (MATRIX_LAYERS * COMMONSENSE_MATRIX_SIZE)];
@@ -25,6 +25,9 @@ typedef struct {
   uint8_t EP;
   uint8_t len;
   uint8_t data[64];
+  // Key event behind the report - see C2CMD_GET_LATENCY. 0 - not a report.
+  uint32_t detected;
+  uint8_t latencyKind;
 } UsbPdu_t;
 
 #define USB_BUFFER_END 15
@@ -36,6 +39,11 @@ UsbPdu_t usbSendingQueue[USB_BUFFER_END + 1];
 uint8_t usbSendingReadPos = 0;
 uint8_t usbSendingWritePos = 0;
 
+// Detection-to-endpoint-load latency, see C2CMD_GET_LATENCY.
+static uint16_t latency_histogram[LATENCY_KINDS][LATENCY_BUCKETS];
+static uint32_t latency_max_us[LATENCY_KINDS];
+#define CYCLES_PER_US (BCLK__BUS_CLK__HZ / 1000000)
+
 // How long (in system ticks) to wait for power to be disconnected
 // Used to tell apart cable disconnect from USB suspend.
 #define POWER_CHECK_DELAY 5000
@@ -52,6 +60,15 @@ void report_status(void) {
   EEPROM_UpdateTemperature();
   outbox.payload[3] = dieTemperature[0];
   outbox.payload[4] = dieTemperature[1];
+  outbox.payload[5] = scancodes_dropped & 0xff;
+  outbox.payload[6] = scancodes_dropped >> 8;
+  outbox.payload[7] = scancodes_high_water;
+  outbox.payload[8] = SCANCODES_SIZE - 1;
+  outbox.payload[9] = config_macros_dropped;
+  outbox.payload[10] = USBQueue_dropped & 0xff;
+  outbox.payload[11] = USBQueue_dropped >> 8;
+  outbox.payload[12] = macros_dropped & 0xff;
+  outbox.payload[13] = macros_dropped >> 8;
   usb_send_c2();
   // xprintf("time: %d", systime);
   // xprintf("LED status: %d %d %d %d %d", led_status&0x01, led_status&0x02,
@@ -90,7 +107,39 @@ void send_config_block(OUT_c2packet_t *inbox) {
   usb_send_c2();
 }
 
+/*
+ * Version 2 had no per-key debouncing, so its macros run that many bytes
+ * longer than config.macros. Returns the length of the records that still
+ * fit, counts the rest in config_macros_dropped.
+ */
+static uint_fast16_t v2_macros_fit(void) {
+  const uint8_t *macros = config.debouncing + sizeof(config.layers);
+  const uint_fast16_t size = sizeof(config.macros) + sizeof(config.debouncing);
+  uint_fast16_t fit = 0;
+  for (uint_fast16_t ptr = 0;
+       ptr + 2 < size && macros[ptr] != EMPTY_FLASH_BYTE;
+       ptr += macros[ptr + 2] + 3) {
+    if (ptr + macros[ptr + 2] + 3 <= sizeof(config.macros)) {
+      fit = ptr + macros[ptr + 2] + 3;
+    } else if (config_macros_dropped < UINT8_MAX) {
+      ++config_macros_dropped;
+    }
+  }
+  return fit;
+}
+
 void set_hardware_parameters(void) {
+  if (config.configVersion == 2) {
+    // Version 3 has per-key debouncing after thresholds - make room.
+    // Last record may be cut in half by the move - end macros before it.
+    const uint_fast16_t macros_fit = v2_macros_fit();
+    memmove(config.layers, config.debouncing,
+            sizeof(config.layers) + sizeof(config.macros));
+    memset(config.macros + macros_fit, EMPTY_FLASH_BYTE,
+           sizeof(config.macros) - macros_fit);
+    memset(config.debouncing, 0, sizeof(config.debouncing));
+    config.configVersion = CS_CONFIG_VERSION;
+  }
   FORCE_BIT(config.capsenseFlags, CSF_NL, NORMALLY_LOW);
   config.matrixRows = MATRIX_ROWS;
   config.matrixCols = MATRIX_COLS;
@@ -110,11 +159,29 @@ void set_hardware_parameters(void) {
   if (config.dischargeDelay < MIN_DISCHARGE_DELAY) {
     config.dischargeDelay = MIN_DISCHARGE_DELAY;
   }
+  // Reserved bytes of older configs are 0xff - governor is off there.
+  if (config.governorSteps > MAX_GOVERNOR_STEPS || config.governorIdle == 0) {
+    config.governorSteps = 0;
+  }
+  if (config.wakeRows > MATRIX_ROWS) {
+    config.wakeRows = 0;
+  }
+  if (config.comboWindow > MAX_COMBO_WINDOW) {
+    config.comboWindow = DEFAULT_COMBO_WINDOW;
+  }
   if (config.debouncingTicks < 1) {
     config.debouncingTicks = 1;
   } else if (config.debouncingTicks > MAX_DEBOUNCING_BUFFER_SIZE) {
     config.debouncingTicks = MAX_DEBOUNCING_BUFFER_SIZE;
   }
+  if (config.debouncingMode != DEBOUNCING_EAGER_PRESS) {
+    config.debouncingMode = DEBOUNCING_SYMMETRIC;
+  }
+  for (uint8_t i = 0; i < COMMONSENSE_MATRIX_SIZE; i++) {
+    if (config.debouncing[i] > MAX_DEBOUNCING_BUFFER_SIZE) {
+      config.debouncing[i] = 0;
+    }
+  }
 }
 
 void load_config(void) {
@@ -131,13 +198,16 @@ void load_config(void) {
   CyEEPROM_ReadRelease();
   CyExitCriticalSection(interruptState);
   EEPROM_Stop();
-  if (config.configVersion != CS_CONFIG_VERSION) {
+  // Version 2 is converted by set_hardware_parameters.
+  if (config.configVersion != CS_CONFIG_VERSION &&
+      config.configVersion != 2) {
     xprintf("Old version of EEPROM - possibly unpredictable results.");
   }
   set_hardware_parameters();
 }
 
 void apply_config(void) {
+  set_hardware_parameters(); // Uploaded config is not sanitized yet.
   exp_init();
   pipeline_init(); // calls scan_reset
   scan_init(config.debouncingTicks);
@@ -173,6 +243,7 @@ void usb_receive(OUT_c2packet_t *inbox) {
       scan_report_insanity();
     }
     report_status();
+    report_telemetry();
     break;
   case C2CMD_SET_MODE:
     FORCE_BIT(status_register, C2DEVSTATUS_SETUP_MODE, inbox->payload[0]);
@@ -203,16 +274,60 @@ void usb_receive(OUT_c2packet_t *inbox) {
     FORCE_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR, inbox->payload[0]);
     scan_reset();
     break;
+  case C2CMD_GET_KEY_STATS:
+    report_key_stats(inbox->payload[0]);
+    break;
+  case C2CMD_CAPTURE_KEY:
+    scan_capture_arm(inbox->payload[0], inbox->payload[1],
+                     inbox->payload[2] | (inbox->payload[3] << 8));
+    break;
+  case C2CMD_GET_LATENCY:
+    report_latency(inbox->payload[0]);
+    break;
   default:
     break;
   }
 }
 
+static void record_latency(uint8_t kind, uint32_t detected) {
+  const uint32_t us = (DWT_CYCCNT_REG - detected) / CYCLES_PER_US;
+  uint32_t bucket = us / LATENCY_BUCKET_US;
+  if (bucket >= LATENCY_BUCKETS) {
+    bucket = LATENCY_BUCKETS - 1;
+  }
+  if (latency_histogram[kind][bucket] < UINT16_MAX) {
+    latency_histogram[kind][bucket]++;
+  }
+  if (us > latency_max_us[kind]) {
+    latency_max_us[kind] = us;
+  }
+}
+
+void report_latency(bool clear) {
+  for (uint8_t kind = 0; kind < LATENCY_KINDS; kind++) {
+    memset(outbox.raw, 0, sizeof(outbox));
+    outbox.response_type = C2RESPONSE_LATENCY;
+    outbox.payload[0] = kind;
+    outbox.payload[1] = LATENCY_BUCKETS;
+    outbox.payload[2] = LATENCY_BUCKET_US & 0xff;
+    outbox.payload[3] = LATENCY_BUCKET_US >> 8;
+    memcpy(&outbox.payload[4], &latency_max_us[kind], 4);
+    memcpy(&outbox.payload[LATENCY_HEADER_SIZE], latency_histogram[kind],
+           sizeof(latency_histogram[kind]));
+    usb_send_c2_blocking();
+  }
+  if (clear) {
+    memset(latency_histogram, 0, sizeof(latency_histogram));
+    memset(latency_max_us, 0, sizeof(latency_max_us));
+  }
+}
+
 void usbEnqueue(uint8_t EP, uint8_t len, uint8_t *data) {
   usbSendingWritePos = USB_BUFFER_NEXT(usbSendingWritePos);
   usbSendingQueue[usbSendingWritePos].EP = EP;
   usbSendingQueue[usbSendingWritePos].len = len;
   memcpy(usbSendingQueue[usbSendingWritePos].data, data, len);
+  usbSendingQueue[usbSendingWritePos].detected = 0;
 }
 
 void usbSend() {
@@ -224,6 +339,10 @@ void usbSend() {
     if (USB_GetEPState(usbSendingQueue[pos].EP) == USB_IN_BUFFER_EMPTY) {
       USB_LoadInEP(usbSendingQueue[pos].EP,
           usbSendingQueue[pos].data, usbSendingQueue[pos].len);
+      if (usbSendingQueue[pos].detected) {
+        record_latency(usbSendingQueue[pos].latencyKind,
+                       usbSendingQueue[pos].detected);
+      }
       usbSendingReadPos = pos;
     } else {
       break;
@@ -231,6 +350,10 @@ void usbSend() {
   }
 }
 
+uint8_t usb_queue_length(void) {
+  return (usbSendingWritePos - usbSendingReadPos) & USB_BUFFER_END;
+}
+
 void usb_send_c2(void) {
   usbEnqueue(OUTBOX_EP, sizeof(outbox.raw), outbox.raw);
 }
@@ -284,6 +407,39 @@ inline void keyboard_release(uint8_t keycode) {
   }
 }
 
+/*
+ * update_*_report only change report state. Changed reports go out together
+ * in usb_flush_reports - one per endpoint, however many events went in.
+ */
+enum { REPORT_KBD, REPORT_CONSUMER, REPORT_SYSTEM, REPORTS };
+static uint8_t reports_changed;
+// Oldest stamped key in the report, see record_latency.
+static uint32_t changed_detected[REPORTS];
+static uint8_t changed_latency_kind[REPORTS];
+
+static inline void stamp_report(uint8_t report, queuedScancode *key) {
+  SET_BIT(reports_changed, report);
+  if (key->detected == 0) {
+    return; // Nothing to measure - macro output past its first step.
+  }
+  // Cycle counter wraps - compare the difference.
+  if (changed_detected[report] == 0 ||
+      (int32_t)(key->detected - changed_detected[report]) < 0) {
+    changed_detected[report] = key->detected;
+    changed_latency_kind[report] = (key->flags & USBQUEUE_RELEASED_MASK)
+                                       ? LATENCY_RELEASE
+                                       : LATENCY_PRESS;
+  }
+}
+
+// Report just enqueued carries the stamp.
+static inline void use_stamp(uint8_t report) {
+  usbSendingQueue[usbSendingWritePos].detected = changed_detected[report];
+  usbSendingQueue[usbSendingWritePos].latencyKind =
+      changed_latency_kind[report];
+  changed_detected[report] = 0;
+}
+
 void update_keyboard_report(queuedScancode *key) {
   // xprintf("Updating report for %d", key->keycode);
   if ((key->flags & USBQUEUE_RELEASED_MASK) == 0) {
@@ -291,13 +447,44 @@ void update_keyboard_report(queuedScancode *key) {
   } else {
     keyboard_release(key->keycode);
   }
-  memcpy(KBD_OUTBOX, keyboard_report.raw, OUTBOX_SIZE(KBD_OUTBOX));
-  if (keyboard_report_usage > KBD_KRO_LIMIT) {
-    // on rollover error ALL keys must report ERO.
-    memset(KBD_OUTBOX + 2, USBCODE_ERO, KBD_KRO_LIMIT);
-    xprintf("Keyboard rollover error");
+  stamp_report(REPORT_KBD, key);
+}
+
+/*
+ * Modifiers saved by PushMods. Pushes past the top aren't saved, only
+ * counted - so pops stay paired with them.
+ */
+#define MODS_STACK_DEPTH 4
+static uint8_t mods_stack[MODS_STACK_DEPTH];
+static uint8_t mods_depth;
+static uint8_t mods_overflow;
+
+void update_keyboard_mods(queuedScancode *key) {
+  switch (key->flags & USBQUEUE_MODS_OP) {
+  case MACRO_MODS_PUSH:
+    if (mods_depth < MODS_STACK_DEPTH) {
+      mods_stack[mods_depth++] = keyboard_report.mods;
+    } else {
+      ++mods_overflow;
+    }
+    keyboard_report.mods = key->mods;
+    break;
+  case MACRO_MODS_POP:
+    if (mods_overflow) {
+      --mods_overflow;
+    } else if (mods_depth) {
+      keyboard_report.mods = mods_stack[--mods_depth];
+    }
+    break;
+  case MACRO_MODS_REVERT:
+    if (mods_depth && !mods_overflow) {
+      keyboard_report.mods = mods_stack[mods_depth - 1];
+    }
+    break;
+  default:
+    return;
   }
-  USB_SEND_REPORT(KBD);
+  SET_BIT(reports_changed, REPORT_KBD);
 }
 
 const uint16_t consumer_mapping[16] = {
@@ -360,8 +547,7 @@ void update_consumer_report(queuedScancode *key) {
   } else {
     consumer_release(keycode);
   }
-  memcpy(CONSUMER_OUTBOX, consumer_report, OUTBOX_SIZE(CONSUMER_OUTBOX));
-  USB_SEND_REPORT(CONSUMER);
+  stamp_report(REPORT_CONSUMER, key);
 }
 
 void update_system_report(queuedScancode *key) {
@@ -371,9 +557,32 @@ void update_system_report(queuedScancode *key) {
   } else {
     system_report[0] &= ~(1 << keyIndex);
   }
-  memcpy(SYSTEM_OUTBOX, system_report, OUTBOX_SIZE(SYSTEM_OUTBOX));
-  // xprintf("System: %d", SYSTEM_OUTBOX[0]);
-  USB_SEND_REPORT(SYSTEM);
+  stamp_report(REPORT_SYSTEM, key);
+}
+
+void usb_flush_reports(void) {
+  if (TEST_BIT(reports_changed, REPORT_KBD)) {
+    memcpy(KBD_OUTBOX, keyboard_report.raw, OUTBOX_SIZE(KBD_OUTBOX));
+    if (keyboard_report_usage > KBD_KRO_LIMIT) {
+      // on rollover error ALL keys must report ERO.
+      memset(KBD_OUTBOX + 2, USBCODE_ERO, KBD_KRO_LIMIT);
+      xprintf("Keyboard rollover error");
+    }
+    USB_SEND_REPORT(KBD);
+    use_stamp(REPORT_KBD);
+  }
+  if (TEST_BIT(reports_changed, REPORT_CONSUMER)) {
+    memcpy(CONSUMER_OUTBOX, consumer_report, OUTBOX_SIZE(CONSUMER_OUTBOX));
+    USB_SEND_REPORT(CONSUMER);
+    use_stamp(REPORT_CONSUMER);
+  }
+  if (TEST_BIT(reports_changed, REPORT_SYSTEM)) {
+    memcpy(SYSTEM_OUTBOX, system_report, OUTBOX_SIZE(SYSTEM_OUTBOX));
+    // xprintf("System: %d", SYSTEM_OUTBOX[0]);
+    USB_SEND_REPORT(SYSTEM);
+    use_stamp(REPORT_SYSTEM);
+  }
+  reports_changed = 0;
 }
 
 void usb_suspend_monitor_start(void) {
@@ -476,6 +685,8 @@ void usb_tick(void) {
 void reset_reports(void) {
   RESET_SINGLE(keyboard_report.raw, KBD)
   keyboard_report_usage = 0;
+  mods_depth = 0;
+  mods_overflow = 0;
   RESET_SINGLE(consumer_report, CONSUMER)
   RESET_SINGLE(system_report, SYSTEM)
   // xprintf("reports reset");
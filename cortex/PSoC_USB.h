@@ -39,6 +39,10 @@ uint8_t system_report[OUTBOX_SIZE(SYSTEM_OUTBOX)];
 
 volatile int32_t ticksToAutonomy;
 
+// Macro records cut off when a version 2 config was converted - no room left
+// for them. See set_hardware_parameters, goes out in C2RESPONSE_STATUS.
+uint8_t config_macros_dropped;
+
 void usb_init(void);
 void usb_configure(void);
 void usb_tick(void);
@@ -48,6 +52,10 @@ void usb_wake(void);
 
 void usb_send_c2();
 void usb_send_c2_blocking();
+// Packets waiting to be picked up by host.
+uint8_t usb_queue_length(void);
+// Detection-to-report latency histograms, see C2CMD_GET_LATENCY.
+void report_latency(bool clear);
 void usb_send_wakeup(void);
 void usb_receive(OUT_c2packet_t *);
 void load_config(void);
@@ -55,8 +63,10 @@ void apply_config(void);
 
 void reset_reports();
 void update_keyboard_report(queuedScancode *key);
+void update_keyboard_mods(queuedScancode *key);
 void update_consumer_report(queuedScancode *key);
 void update_system_report(queuedScancode *key);
+void usb_flush_reports(void);
 
 #if NOT_A_KEYBOARD == 1
 #define _WIPE_OUTBOX(OUTBOX) memset(OUTBOX, 0, OUTBOX_SIZE(OUTBOX))
@@ -33,6 +33,9 @@ inline void setup() {
 #endif
   ILO_Trim_Start();
   ILO_Trim_BeginTrimming();
+  DEMCR_REG |= DEMCR_TRCENA;
+  DWT_CYCCNT_REG = 0;
+  DWT_CTRL_REG |= DWT_CTRL_CYCCNTENA;
   CyGlobalIntEnable; /* Enable global interrupts. */
   BootIRQ_StartEx(BootIRQ_ISR);
   SysTimer_Start();
@@ -81,7 +84,9 @@ inline void main_loop() {
       serial_tick();
       usb_tick();
       // Timer ISR will wake us up.
+      const uint32_t sleep_start = DWT_CYCCNT_REG;
       CyPmAltAct(PM_ALT_ACT_TIME_NONE, PM_ALT_ACT_SRC_NONE);
+      idle_cycles += DWT_CYCCNT_REG - sleep_start;
       break;
     case DEVSTATE_PREPARING_TO_SLEEP:
       if (tick) {
@@ -96,7 +101,7 @@ inline void main_loop() {
       CyPmAltAct(PM_ALT_ACT_TIME_NONE, PM_ALT_ACT_SRC_NONE);
       break;
     case DEVSTATE_WATCH:
-      if (tick > SUSPEND_SYSTIMER_DIVISOR) {
+      if (tick > SUSPEND_SYSTIMER_DIVISOR || (tick && scan_wake_pending)) {
         tick = 0;
         scan_start();
         if (pipeline_process_wakeup()) {
@@ -112,6 +112,24 @@ psoc_eeprom_t config;
 volatile uint8_t tick;
 volatile uint32_t systime;
 
+// Cortex-M3 DWT cycle counter - enabled in setup().
+// Host tests bring their own counter and barrier - see cortex/tests.
+#ifndef DWT_CYCCNT_REG
+#define DEMCR_REG (*(volatile uint32_t *)0xE000EDFCu)
+#define DEMCR_TRCENA (1 << 24)
+#define DWT_CTRL_REG (*(volatile uint32_t *)0xE0001000u)
+#define DWT_CTRL_CYCCNTENA 1
+#define DWT_CYCCNT_REG (*(volatile uint32_t *)0xE0001004u)
+#endif
+// Keeps ISR/main loop ring buffer slot accesses on their side of index
+// updates. CMSIS __DMB is static inline - can't be used in extern inlines.
+#ifndef MEMORY_BARRIER
+#define MEMORY_BARRIER() __asm volatile("dmb" ::: "memory")
+#endif
+
+// Cycles main loop spent asleep, for telemetry.
+uint32_t idle_cycles;
+
 enum devicePowerStates {
   DEVSTATE_FULL_THROTTLE = 1, // Going full bore
   DEVSTATE_PREPARING_TO_SLEEP, // USB suspend condition detected
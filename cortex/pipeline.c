@@ -15,10 +15,64 @@
 #include "PSoC_USB.h"
 #include "sup_serial.h"
 
+/*
+ * Tap-hold. Key with a tap macro doesn't go out on press - it waits at the
+ * head of tap_buffer, and everything after it waits behind it, in order.
+ * Head resolves as:
+ * - tap - released before tap_deadline, no other key went down and up
+ *   meanwhile. Tap macro plays, release is eaten;
+ * - hold - tap_deadline passed, or other key went down and up while it's
+ *   down (permissive hold), or buffer is full. Press macro or the key goes
+ *   out.
+ * Then events behind it are fed again - next tap key becomes the head, its
+ * deadline counted from its own press. Latency is at most DELAYS_TAP.
+ */
+#define TAP_BUFFER_SIZE 16
+typedef struct {
+  scancode_t sc;
+  uint32_t time;  // systime when read.
+  uint8_t usb_sc; // Fired combo output, 0 - look it up in keymap.
+} tap_event_t;
+tap_event_t tap_buffer[TAP_BUFFER_SIZE];
+uint8_t tap_buffered;
+// Head of tap_buffer, resolved at press.
 uint8_t tap_usb_sc;
 uint32_t tap_deadline;
 uint_fast16_t saved_macro_ptr;
 
+/*
+ * Layer resolution, rebuilt from config by pipeline_init.
+ * layer_lut: layer for every layerMods state, LAYER_UNCHANGED if no
+ * condition matches.
+ * keymap: layers with transparent keys already resolved through lower
+ * layers - lookup is one load, however many layers there are.
+ */
+#define LAYER_UNCHANGED 0xff
+uint8_t layer_lut[1 << (8 - LAYER_MODS_SHIFT)];
+uint8_t keymap[MATRIX_LAYERS][COMMONSENSE_MATRIX_SIZE];
+
+static void build_keymap(void) {
+  memset(layer_lut, LAYER_UNCHANGED, sizeof(layer_lut));
+  // First matching condition wins - go backwards so earlier ones overwrite.
+  for (int8_t i = sizeof(config.layerConditions) - 1; i >= 0; i--) {
+    const uint8_t layer = config.layerConditions[i] & 0x0f;
+    if (layer < MATRIX_LAYERS) {
+      layer_lut[config.layerConditions[i] >> LAYER_MODS_SHIFT] = layer;
+    }
+  }
+  memcpy(keymap[0], config.layers[0], sizeof(keymap[0]));
+  for (uint8_t layer = 1; layer < MATRIX_LAYERS; layer++) {
+    for (uint8_t i = 0; i < COMMONSENSE_MATRIX_SIZE; i++) {
+      const uint8_t usb_sc = config.layers[layer][i];
+      keymap[layer][i] =
+          (usb_sc == USBCODE_TRANSPARENT) ? keymap[layer - 1][i] : usb_sc;
+    }
+  }
+  if (currentLayer >= MATRIX_LAYERS) {
+    currentLayer = 0;
+  }
+}
+
 inline void process_layerMods(uint8_t flags, uint8_t keycode) {
   // codes A8-AB - momentary selection(Fn), AC-AF - permanent(LLck)
   if (keycode & 0x04) {
@@ -35,21 +89,94 @@ inline void process_layerMods(uint8_t flags, uint8_t keycode) {
     CLEAR_BIT(layerMods, (keycode & 0x03) + LAYER_MODS_SHIFT);
   }
   // Figure layer condition
-  for (uint8_t i = 0; i < sizeof(config.layerConditions); i++) {
-    if (layerMods == (config.layerConditions[i] & 0xf0)) {
-      currentLayer = config.layerConditions[i] & 0x0f;
-      break;
-    }
+  const uint8_t layer = layer_lut[layerMods >> LAYER_MODS_SHIFT];
+  if (layer != LAYER_UNCHANGED) {
+    currentLayer = layer;
   }
 #ifdef DEBUG_PIPELINE
   xprintf("L@%d: %02x %02x -> %d", systime, flags, keycode, currentLayer);
 #endif
 }
 
+/*
+ * Macro index, rebuilt from config by pipeline_init.
+ * Bit per keycode that triggers any macro. First MACRO_INDEX_SIZE of those
+ * keycodes get a slot with offsets of their first macro of every kind -
+ * slot is the number of bits set below the keycode. Keycodes past that are
+ * looked up the slow way.
+ */
+#define MACRO_INDEX_SIZE 64
+#define MACRO_INDEX_NONE 0xffff
+enum { MACRO_ON_PRESS, MACRO_ON_PRESS_NO_TAP, MACRO_ON_RELEASE, MACRO_KINDS };
+uint32_t macro_keys[256 / 32];
+uint8_t macro_keys_below[256 / 32];
+uint16_t macro_index[MACRO_INDEX_SIZE][MACRO_KINDS];
+#define MACRO_SLOT(KC)                                                         \
+  (macro_keys_below[(KC) >> 5] +                                               \
+   __builtin_popcount(macro_keys[(KC) >> 5] & ((1UL << ((KC)&31)) - 1)))
+#define MACRO_NEXT(PTR) ((PTR) + config.macros[(PTR) + 2] + 3)
+#define MACRO_IS_RECORD(PTR)                                                   \
+  ((PTR) + 2 < sizeof config.macros && config.macros[PTR] != EMPTY_FLASH_BYTE)
+
+static void build_macro_index(void) {
+  memset(macro_keys, 0, sizeof(macro_keys));
+  memset(macro_index, 0xff, sizeof(macro_index));
+  for (uint_fast16_t ptr = 0; MACRO_IS_RECORD(ptr); ptr = MACRO_NEXT(ptr)) {
+    if (config.macros[ptr + 1] & MACRO_TYPE_COMBO) {
+      continue; // Not a macro - see build_combos.
+    }
+    const uint8_t keycode = config.macros[ptr];
+    macro_keys[keycode >> 5] |= 1UL << (keycode & 31);
+  }
+  uint8_t below = 0;
+  for (uint8_t i = 0; i < 256 / 32; i++) {
+    macro_keys_below[i] = below;
+    below += __builtin_popcount(macro_keys[i]);
+  }
+  // Same order lookup_macro used to walk them in - first one wins.
+  for (uint_fast16_t ptr = 0; MACRO_IS_RECORD(ptr); ptr = MACRO_NEXT(ptr)) {
+    const uint8_t slot = MACRO_SLOT(config.macros[ptr]);
+    if (slot >= MACRO_INDEX_SIZE ||
+        (config.macros[ptr + 1] & MACRO_TYPE_COMBO)) {
+      continue;
+    }
+    uint16_t *entry = macro_index[slot];
+    const uint8_t mFlags = config.macros[ptr + 1];
+    if (mFlags & MACRO_TYPE_ONKEYUP) {
+      if (entry[MACRO_ON_RELEASE] == MACRO_INDEX_NONE) {
+        entry[MACRO_ON_RELEASE] = ptr;
+      }
+      continue;
+    }
+    if (entry[MACRO_ON_PRESS] == MACRO_INDEX_NONE) {
+      entry[MACRO_ON_PRESS] = ptr;
+    }
+    if ((mFlags & MACRO_TYPE_TAP) == 0 &&
+        entry[MACRO_ON_PRESS_NO_TAP] == MACRO_INDEX_NONE) {
+      entry[MACRO_ON_PRESS_NO_TAP] = ptr;
+    }
+  }
+}
+
 /*
  * Data structure: [scancode][flags][data length][macro data]
  */
-inline uint_fast16_t lookup_macro(uint8_t flags, uint8_t keycode) {
+inline uint_fast16_t lookup_macro(uint8_t flags, uint8_t keycode,
+                                  bool no_tap) {
+  if ((macro_keys[keycode >> 5] & (1UL << (keycode & 31))) == 0) {
+    return MACRO_NOT_FOUND;
+  }
+  const uint8_t slot = MACRO_SLOT(keycode);
+  if (slot < MACRO_INDEX_SIZE) {
+    uint8_t kind = MACRO_ON_PRESS;
+    if (flags & USBQUEUE_RELEASED_MASK) {
+      kind = MACRO_ON_RELEASE;
+    } else if (no_tap) {
+      kind = MACRO_ON_PRESS_NO_TAP;
+    }
+    const uint16_t ptr = macro_index[slot][kind];
+    return (ptr == MACRO_INDEX_NONE) ? MACRO_NOT_FOUND : ptr;
+  }
   uint_fast16_t ptr = 0;
   do {
 #if USBQUEUE_RELEASED_MASK != MACRO_TYPE_ONKEYUP
@@ -59,8 +186,10 @@ inline uint_fast16_t lookup_macro(uint8_t flags, uint8_t keycode) {
     if (config.macros[ptr] == keycode && // obvious..
         // only keyUp macros on keyUp (tap and keyDn on keyDn)..
         ((flags ^ mFlags) & USBQUEUE_RELEASED_MASK) == 0 &&
-        // in tap wait, skip tap macros. See TapWait processing for why.
-        (tap_deadline == 0 || (mFlags & MACRO_TYPE_TAP) == 0)) {
+        // tap key held, skip tap macros. See tap_resolve for why.
+        (!no_tap || (mFlags & MACRO_TYPE_TAP) == 0) &&
+        // combos are no macros.
+        (mFlags & MACRO_TYPE_COMBO) == 0) {
       return ptr;
     } else {
       ptr += config.macros[ptr + 2] + 3; // length + header size
@@ -70,7 +199,34 @@ inline uint_fast16_t lookup_macro(uint8_t flags, uint8_t keycode) {
   return MACRO_NOT_FOUND;
 }
 
-inline void queue_usbcode(uint32_t time, uint8_t flags, uint8_t keycode) {
+#define USBQUEUE_BEFORE(A, B)                                                  \
+  ((A)->sysTime < (B)->sysTime ||                                              \
+   ((A)->sysTime == (B)->sysTime && (A)->seq < (B)->seq))
+
+// Inserts into USBQueue, assigns seq. Full queue drops the event.
+inline void push_usbcode(queuedScancode *event) {
+  if (USBQueue_length == USBQUEUE_SIZE) {
+    if (USBQueue_dropped < UINT16_MAX) {
+      ++USBQueue_dropped;
+    }
+    return;
+  }
+  event->seq = USBQueue_seq++;
+  // Sift up - parent of i is (i-1)/2.
+  uint8_t pos = USBQueue_length++;
+  while (pos > 0) {
+    const uint8_t parent = (pos - 1) / 2;
+    if (!USBQUEUE_BEFORE(event, &USBQueue[parent])) {
+      break;
+    }
+    USBQueue[pos] = USBQueue[parent];
+    pos = parent;
+  }
+  USBQueue[pos] = *event;
+}
+
+inline void queue_usbcode(uint32_t time, uint8_t flags, uint8_t keycode,
+                          uint32_t detected) {
 #ifdef DEBUG_PIPELINE
   xprintf("Q@%d: %02x %d @%+d", systime, flags, keycode, time - systime);
 #endif
@@ -92,41 +248,110 @@ inline void queue_usbcode(uint32_t time, uint8_t flags, uint8_t keycode) {
     process_layerMods(flags, keycode);
     return;
   }
-  // Trick - even if current buffer position is empty, write to the next one.
-  // It may be empty because reader already processed it.
-  USBQueue_wpos = KEYCODE_BUFFER_NEXT(USBQueue_wpos);
-  // Make sure not to overwrite pending events - TODO think how not to fall into
-  // infinite loop if buffer full.
-  while (USBQueue[USBQueue_wpos].keycode != USBCODE_NOEVENT) {
-    USBQueue_wpos = KEYCODE_BUFFER_NEXT(USBQueue_wpos);
-  }
-  USBQueue[USBQueue_wpos].sysTime = time;
-  USBQueue[USBQueue_wpos].flags = flags;
-  USBQueue[USBQueue_wpos].keycode = keycode;
+  queuedScancode event;
+  event.sysTime = time;
+  event.flags = flags;
+  event.keycode = keycode;
+  event.mods = 0;
+  event.detected = detected;
+  push_usbcode(&event);
 }
 
-inline void play_macro(uint_fast16_t start) {
-  uint8_t *mptr = &config.macros[start] + 3;
-  uint8_t *macro_end = mptr + config.macros[start + 2];
+// Mods stack operation, see macroModsOp. mods only matter for PushMods.
+inline void queue_mods(uint32_t time, uint8_t op, uint8_t mods) {
 #ifdef DEBUG_PIPELINE
-  xprintf("PM@%d: %d, sz: %d", systime, start, config.macros[start + 2]);
+  xprintf("QM@%d: %d %02x @%+d", systime, op, mods, time - systime);
 #endif
-  uint32_t now = systime;
-  uint_fast16_t delay;
-  uint8_t keyflags;
-  while (mptr <= macro_end) {
-    delay = config.delayLib[(*mptr >> 2) & 0x0f];
+  queuedScancode event;
+  event.sysTime = time;
+  event.flags = USBQUEUE_RELEASED_MASK | USBQUEUE_MODS_MASK |
+                (op & USBQUEUE_MODS_OP);
+  event.keycode = USBCODE_TRANSPARENT;
+  event.mods = mods;
+  event.detected = 0;
+  push_usbcode(&event);
+}
+
+// Takes the head of the heap out, last item sifts down into its place.
+inline void dequeue_usbcode(void) {
+  const queuedScancode last = USBQueue[--USBQueue_length];
+  const uint8_t length = USBQueue_length;
+  uint8_t pos = 0;
+  for (;;) {
+    uint8_t child = pos * 2 + 1;
+    if (child >= length) {
+      break;
+    }
+    if (child + 1 < length &&
+        USBQUEUE_BEFORE(&USBQueue[child + 1], &USBQueue[child])) {
+      ++child;
+    }
+    if (!USBQUEUE_BEFORE(&USBQueue[child], &last)) {
+      break;
+    }
+    USBQueue[pos] = USBQueue[child];
+    pos = child;
+  }
+  USBQueue[pos] = last;
+}
+
+// Trigger's detection stamp only goes with events due when the macro
+// started - later ones are late on purpose, latency stats skip them.
+inline void macro_queue(const macro_player_t *player, uint32_t time,
+                        uint8_t flags, uint8_t keycode) {
+  queue_usbcode(time, flags, keycode,
+                time == player->started ? player->detected : 0);
+}
+
+/*
+ * Next TypeString character. Shift goes down before the first character that
+ * needs it and up before the first one that doesn't, or after the last one.
+ */
+inline void type_string_char(macro_player_t *player) {
+  const uint_fast16_t delay = config.delayLib[player->string_delay];
+  const uint8_t c = config.macros[player->pc++];
+  const bool shift = (c & MACRO_CHAR_SHIFT) != 0;
+  if (shift != player->string_shift) {
+    macro_queue(player, player->due, shift ? 0 : USBQUEUE_RELEASED_MASK,
+                USBCODE_LEFT_SHIFT);
+    player->string_shift = shift;
+  }
+  const uint8_t keycode = c & ~MACRO_CHAR_SHIFT;
+  macro_queue(player, player->due, 0, keycode);
+  macro_queue(player, player->due + delay, USBQUEUE_RELEASED_MASK, keycode);
+  player->due += delay;
+  if (--player->string_left == 0 && player->string_shift) {
+    macro_queue(player, player->due, USBQUEUE_RELEASED_MASK,
+                USBCODE_LEFT_SHIFT);
+    player->string_shift = false;
+  }
+}
+
+// Runs macro commands that are due. False when the macro is over.
+inline bool run_macro(macro_player_t *player) {
+  while (player->pc < player->end) {
+    if (player->due > systime) {
+      return true;
+    }
+    if (player->string_left) {
+      type_string_char(player);
+      continue;
+    }
+    const uint8_t *mptr = &config.macros[player->pc];
+    const uint_fast16_t delay = config.delayLib[(*mptr >> 2) & 0x0f];
+    uint8_t keyflags;
     switch (*mptr >> 6) {
     // Check first 2 bits - macro command
     case 0: // TypeOneKey
       // Press+release, timing from delayLib
-      mptr++;
-      // FIXME possible to queue USB_NOEVENT.
-      // This will most likely trigger exp. header, but may be as bad as
-      // infinite loop.
-      queue_usbcode(now, 0, *mptr);
-      now += delay;
-      queue_usbcode(now, USBQUEUE_RELEASED_MASK, *mptr);
+      if (player->pc + 1 >= player->end) {
+        return false; // Truncated.
+      }
+      macro_queue(player, player->due, 0, mptr[1]);
+      macro_queue(player, player->due + delay, USBQUEUE_RELEASED_MASK,
+                  mptr[1]);
+      player->due += delay;
+      player->pc += 2;
       break;
     case 1: // ChangeMods - currently PressKey and ReleaseKey
       /*
@@ -136,15 +361,30 @@ inline void play_macro(uint_fast16_t start) {
        * Now, though, it's 
        * [4 bits delay, 1 bit direction, 1 bit reserved, 1 byte scancode]
        */
+      if (player->pc + 1 >= player->end) {
+        return false;
+      }
       keyflags =
           (*mptr & MACRO_KEY_UPDOWN_RELEASE) ? USBQUEUE_RELEASED_MASK : 0;
-      mptr++;
-      queue_usbcode(now, keyflags, *mptr);
-      now += delay;
+      macro_queue(player, player->due, keyflags, mptr[1]);
+      player->due += delay;
+      player->pc += 2;
       break;
     case 2: // Mods stack manipulation
-      // 2 bits - PushMods, PopMods, RevertMods.
-      // Not used currently.
+      // 2 bits - PushMods, PopMods, RevertMods, see macroModsOp.
+      // Done when the event goes out, so keys queued before it go with the
+      // modifiers they were meant to.
+      if ((*mptr & 0x03) == MACRO_MODS_PUSH) {
+        if (player->pc + 1 >= player->end) {
+          return false;
+        }
+        queue_mods(player->due, MACRO_MODS_PUSH, mptr[1]);
+        player->pc++;
+      } else {
+        queue_mods(player->due, *mptr & 0x03, 0);
+      }
+      player->due += delay;
+      player->pc++;
       break;
     case 3: // Wait
       /* 4 bits for delay. Initially had special value of 
@@ -152,73 +392,425 @@ inline void play_macro(uint_fast16_t start) {
        * But since now we have separate triggers on press and release - all
        * values are from delayLib.
        */
-      now += delay;
+      if (*mptr & MACRO_WAIT_TYPE_STRING) {
+        // TypeString. Characters go out one by one, see type_string_char.
+        if (player->pc + 1 >= player->end) {
+          return false;
+        }
+        player->string_left = mptr[1];
+        if (player->string_left > player->end - player->pc - 2) {
+          player->string_left = player->end - player->pc - 2; // Truncated.
+        }
+        player->string_delay = (*mptr >> 2) & 0x0f;
+        player->pc += 2;
+        break;
+      }
+      player->due += delay;
+      player->pc++;
       break;
-    default:
-      return;
     }
-    mptr++;
+  }
+  return false;
+}
+
+/*
+ * Macros are played as they go - every playing macro has its next command
+ * and the time it's due, see run_macro. Memory doesn't depend on macro
+ * length, and a long macro doesn't hold up anything else.
+ */
+inline void play_macro(uint_fast16_t start, uint32_t detected) {
+#ifdef DEBUG_PIPELINE
+  xprintf("PM@%d: %d, sz: %d", systime, start, config.macros[start + 2]);
+#endif
+  if (macro_players_active == MAX_PLAYING_MACROS) {
+    if (macros_dropped < UINT16_MAX) {
+      ++macros_dropped;
+    }
+    return;
+  }
+  macro_player_t *player = &macro_players[macro_players_active++];
+  player->pc = start + 3;
+  player->end = player->pc + config.macros[start + 2];
+  player->due = systime;
+  player->started = systime;
+  player->detected = detected;
+  player->string_left = 0;
+  player->string_shift = false;
+  // Commands due now are queued right away - events processed after the
+  // trigger must not overtake them.
+  if (!run_macro(player)) {
+    --macro_players_active;
   }
 }
 
+// Finished macros drop out, the rest keep their order.
+inline void run_macros(void) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < macro_players_active; i++) {
+    if (run_macro(&macro_players[i])) {
+      macro_players[kept++] = macro_players[i];
+    }
+  }
+  macro_players_active = kept;
+}
+
+// Consumer side of the scancode ring, see scan.h.
 inline scancode_t read_scancode(void) {
-  if (scancodes_rpos == scancodes_wpos) {
+  const uint8_t rpos = scancodes_rpos;
+  if (rpos == scancodes_wpos) {
     // Nothing to read. Return empty value AKA "Pressed nokey".
     scancode_t result;
     result.flags = 0;
     result.scancode = COMMONSENSE_NOKEY;
     return result;
   }
-  // Skip empty elements that might be there
-  while (scancodes[scancodes_rpos].scancode == COMMONSENSE_NOKEY &&
-        (scancodes[scancodes_rpos].flags & USBQUEUE_RELEASED_MASK) == 0
-  ) {
-    scancodes_rpos = SCANCODES_NEXT(scancodes_rpos);
-  }
-  // MOVE the value from ring buffer to output buffer. Mark source as empty.
-  scancode_t scancode = scancodes[scancodes_rpos];
-  scancodes[scancodes_rpos].flags = 0;
-  scancodes[scancodes_rpos].scancode = COMMONSENSE_NOKEY;
+  scancode_t scancode = scancodes[rpos];
+  MEMORY_BARRIER(); // Slot must be read before writer can reuse it.
+  scancodes_rpos = SCANCODES_NEXT(rpos);
 #ifdef MATRIX_LEVELS_DEBUG
-  xprintf("sc: %d %d @ %d ms, lvl %d/%d", scancode & KEY_UP_MASK,
-          scancode & SCANCODE_MASK, systime,
-          level_buffer[scancodes_rpos],
-          level_buffer_inst[scancodes_rpos]);
+  xprintf("sc: %d %d @ %d ms", scancode.flags & KEY_UP_MASK,
+          scancode.scancode, systime);
 #endif
   return scancode;
 }
 
-bool reports_reset_pending;
-inline void process_real_key(void) {
-  if (tap_deadline > 0 && systime > tap_deadline) {
-    // Tap timeout. MAKE DOUBLE SURE this is a timeout situation.
-    // Clownetowne: we need to switch from TapWait to normal mode and send that
-    // keyDown. So we send ANOTHER keyDown for the trigger key, but let our
-    // later self know it's actually a timeout.
+// Key event past tap-hold - layers, macros, USB queue.
+inline void process_key(const tap_event_t *event) {
+  const scancode_t sc = event->sc;
+  // Resolve USB keycode using current active layers - see build_keymap.
+  const uint8_t usb_sc =
+      event->usb_sc ? event->usb_sc : keymap[currentLayer][sc.scancode];
+  if (usb_sc == USBCODE_TRANSPARENT) {
+    // Empty key in layout from current layer down to base. Fuck no, DON'T EVER.
+    return;
+  }
 #ifdef DEBUG_PIPELINE
-    xprintf("Tap@%d: %d timed out", systime, saved_macro_ptr);
+  xprintf("SC@%d: %02x %02x@L%d -> %d",
+          systime, sc.flags, sc.scancode, currentLayer, usb_sc);
 #endif
-    saved_macro_ptr = MACRO_NOT_FOUND; // Large-ish footgun!
-  } else if (reports_reset_pending) {
-    if (USBQUEUE_IS_EMPTY) {
-      // ONLY reset if there are no pending USB events.
-      // Those are supposed to only be generated by macros, but who knows.
-      reset_reports();
-      serial_reset_reports();
-      reports_reset_pending = false;
-    }
-    if (reports_reset_pending) {
-      // It is possible to get stuck here for LONG TIME if user makes something
-      // stupid (namely, long macro with huge delays), triggers it and releases
-      // all keys (see next big comment why that's important).
-      // Scancodes will be generated, but not processed until _ALL_ USB events
-      // generated by that macro are dispatched to host. Scancodes ring buffer
-      // can overflow - not causing memory corruption, but losing some events.
-      // Which _is_ bad, don't get me wrong - but user had it coming.
-      return;
+  const uint8_t keyflags = sc.flags | USBQUEUE_REAL_KEY_MASK;
+  // Trick: FlightController must save tap macros before keyDown macros - so
+  // if both defined, we find tap first.
+  const uint_fast16_t macro_ptr = lookup_macro(keyflags, usb_sc, false);
+  if (macro_ptr != MACRO_NOT_FOUND) {
+    if ((config.macros[macro_ptr + 1] & MACRO_TYPE_TAP) == 0) {
+      play_macro(macro_ptr, sc.detected);
+    } else {
+      // Tap macro cannot be selected for keyUp. So this must be keyDown.
+      // Key waits at the head of tap_buffer.
+      saved_macro_ptr = macro_ptr;
+      tap_usb_sc = usb_sc;
+      tap_deadline = event->time + config.delayLib[DELAYS_TAP];
+      tap_buffer[0] = *event;
+      tap_buffered = 1;
     }
+    return;
+  }
+  // OK. Not macro.
+  queue_usbcode(systime, keyflags, usb_sc, sc.detected);
+}
+
+// Not inline here - feed_key and tap_resolve call each other, so one of them
+// can't be inlined everywhere and needs an external definition.
+void tap_resolve(void);
+
+// Event waits if a tap key is pending, goes through otherwise.
+inline void feed_key(const tap_event_t *event) {
+  if (tap_buffered == TAP_BUFFER_SIZE) {
+    // Full buffer resolves the head as a hold at the latest - makes room.
+    tap_resolve();
+  }
+  if (tap_buffered > 0) {
+    tap_buffer[tap_buffered++] = *event;
+  } else {
+    process_key(event);
+  }
+}
+
+inline void tap_resolve(void) {
+  while (tap_buffered > 0) {
+    const scancode_t head = tap_buffer[0].sc;
+    // Other keys that went down after the head.
+    uint32_t down[(COMMONSENSE_MATRIX_SIZE + 31) / 32] = {0};
+    uint8_t release = 0;
+    bool hold = false;
+    for (uint8_t i = 1; i < tap_buffered && !hold && !release; i++) {
+      const scancode_t sc = tap_buffer[i].sc;
+      const uint32_t bit = 1UL << (sc.scancode & 31);
+      if (sc.scancode == head.scancode) {
+        release = i; // Head can't go down again before it's up.
+      } else if ((sc.flags & KEY_UP_MASK) == 0) {
+        down[sc.scancode >> 5] |= bit;
+      } else if (down[sc.scancode >> 5] & bit) {
+        hold = true; // Permissive hold.
+      }
+    }
+    if (release && tap_buffer[release].time > tap_deadline) {
+      // Released too late, but read in the same tick the deadline passed
+      // or came late from the scancode ring.
+      hold = true;
+    }
+    if (!release && !hold) {
+      hold = systime > tap_deadline || tap_buffered == TAP_BUFFER_SIZE;
+      if (!hold) {
+        return; // Undecided yet.
+      }
+    }
+    if (hold) {
+#ifdef DEBUG_PIPELINE
+      xprintf("Hold@%d: %d", systime, tap_usb_sc);
+#endif
+      // There COULD HAVE BEEN a keyDown macro on that key.
+      // keyUp will go business-as-usual way.
+      const uint_fast16_t macro_ptr =
+          lookup_macro(USBQUEUE_REAL_KEY_MASK, tap_usb_sc, true);
+      if (macro_ptr == MACRO_NOT_FOUND) {
+        queue_usbcode(systime, USBQUEUE_REAL_KEY_MASK, tap_usb_sc,
+                      head.detected);
+      } else {
+        play_macro(macro_ptr, head.detected);
+      }
+      release = 0;
+    } else {
+#ifdef DEBUG_PIPELINE
+      xprintf("Tap@%d: %d", systime, saved_macro_ptr);
+#endif
+      // Release is eaten - tap is known from it, latency too.
+      play_macro(saved_macro_ptr, tap_buffer[release].sc.detected);
+    }
+    // Feed the rest again - may start the next tap key.
+    tap_event_t rest[TAP_BUFFER_SIZE];
+    uint8_t count = 0;
+    for (uint8_t i = 1; i < tap_buffered; i++) {
+      if (i != release) {
+        rest[count++] = tap_buffer[i];
+      }
+    }
+    tap_buffered = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      feed_key(&rest[i]);
+    }
+  }
+}
+
+/*
+ * Combos - member keys pressed together send another keycode. Table is
+ * built by pipeline_init from MACRO_TYPE_COMBO records in config.macros:
+ * [output keycode][MACRO_TYPE_COMBO][n][n keycodes], keys named by their
+ * base layer keycodes. Member presses wait in combo_pending until:
+ * - they match a combo and can't grow into a bigger one - combo fires;
+ * - they can't make any combo - they go out as usual;
+ * - config.comboWindow passes, other key goes down or any key goes up -
+ *   combo fires if they match one, otherwise they go out.
+ * Keys in no combo pass straight through while nothing is pending. Fired
+ * combo is released by the first member release, the rest are eaten.
+ */
+#define MAX_COMBOS 16
+#define MAX_ACTIVE_COMBOS 4
+#define COMBO_NONE 0xff
+typedef struct {
+  uint8_t usb_sc;
+  uint8_t count;
+  uint8_t keys[MAX_COMBO_KEYS]; // Matrix positions.
+} combo_t;
+combo_t combos[MAX_COMBOS];
+uint8_t combo_count;
+uint32_t combo_members[(COMMONSENSE_MATRIX_SIZE + 31) / 32];
+tap_event_t combo_pending[MAX_COMBO_KEYS];
+uint8_t combo_pending_count;
+uint32_t combo_deadline;
+typedef struct {
+  uint8_t combo;
+  uint8_t scancode; // Position the output press went out at.
+  uint8_t down;     // Bit per combo key not released yet.
+} active_combo_t;
+active_combo_t active_combos[MAX_ACTIVE_COMBOS];
+uint8_t active_combo_count;
+
+static void build_combos(void) {
+  combo_count = 0;
+  combo_pending_count = 0;
+  active_combo_count = 0;
+  memset(combo_members, 0, sizeof(combo_members));
+  if (config.comboWindow == 0) {
+    return; // Combos off.
+  }
+  for (uint_fast16_t ptr = 0; MACRO_IS_RECORD(ptr) && combo_count < MAX_COMBOS;
+       ptr = MACRO_NEXT(ptr)) {
+    const uint8_t len = config.macros[ptr + 2];
+    if ((config.macros[ptr + 1] & MACRO_TYPE_COMBO) == 0 || len < 2 ||
+        len > MAX_COMBO_KEYS || ptr + 3 + len > sizeof config.macros) {
+      continue;
+    }
+    combo_t *combo = &combos[combo_count];
+    combo->usb_sc = config.macros[ptr];
+    combo->count = 0;
+    for (uint8_t i = 0; i < len; i++) {
+      // Member is the first base layer key with that keycode.
+      const uint8_t keycode = config.macros[ptr + 3 + i];
+      uint8_t pos = 0;
+      while (pos < COMMONSENSE_MATRIX_SIZE &&
+             config.layers[0][pos] != keycode) {
+        pos++;
+      }
+      if (pos == COMMONSENSE_MATRIX_SIZE) {
+        break;
+      }
+      combo->keys[combo->count++] = pos;
+    }
+    if (combo->count < len) {
+      continue; // Not all keys are on the base layer.
+    }
+    for (uint8_t i = 0; i < combo->count; i++) {
+      combo_members[combo->keys[i] >> 5] |= 1UL << (combo->keys[i] & 31);
+    }
+    combo_count++;
+  }
+}
+
+// Combos that have all pending keys. exact - first of those that has no
+// other keys, COMBO_NONE if there's none.
+inline uint8_t combo_match(uint8_t *exact) {
+  uint8_t candidates = 0;
+  *exact = COMBO_NONE;
+  for (uint8_t c = 0; c < combo_count; c++) {
+    const combo_t *combo = &combos[c];
+    uint8_t found = 0;
+    for (uint8_t i = 0; i < combo_pending_count; i++) {
+      for (uint8_t j = 0; j < combo->count; j++) {
+        if (combo->keys[j] == combo_pending[i].sc.scancode) {
+          found++;
+          break;
+        }
+      }
+    }
+    if (found < combo_pending_count) {
+      continue;
+    }
+    candidates++;
+    if (found == combo->count && *exact == COMBO_NONE) {
+      *exact = c;
+    }
+  }
+  return candidates;
+}
+
+// Pending keys are final - fire the combo they make or let them go.
+inline void combo_resolve(void) {
+  if (combo_pending_count == 0) {
+    return;
+  }
+  uint8_t exact;
+  combo_match(&exact);
+  if (exact == COMBO_NONE || active_combo_count == MAX_ACTIVE_COMBOS) {
+    const uint8_t count = combo_pending_count;
+    combo_pending_count = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      feed_key(&combo_pending[i]);
+    }
+    return;
+  }
+#ifdef DEBUG_PIPELINE
+  xprintf("Combo@%d: %d", systime, combos[exact].usb_sc);
+#endif
+  // Output goes at the first key's position and detection time - latency
+  // stats see the wait.
+  tap_event_t press = combo_pending[0];
+  press.usb_sc = combos[exact].usb_sc;
+  active_combo_t *active = &active_combos[active_combo_count++];
+  active->combo = exact;
+  active->scancode = press.sc.scancode;
+  active->down = (1 << combos[exact].count) - 1;
+  combo_pending_count = 0;
+  feed_key(&press);
+}
+
+// Release of a fired combo member - true if it's one.
+inline bool combo_release(const tap_event_t *event) {
+  for (uint8_t a = 0; a < active_combo_count; a++) {
+    active_combo_t *active = &active_combos[a];
+    const combo_t *combo = &combos[active->combo];
+    for (uint8_t i = 0; i < combo->count; i++) {
+      if (combo->keys[i] != event->sc.scancode ||
+          (active->down & (1 << i)) == 0) {
+        continue;
+      }
+      if (active->down == (1 << combo->count) - 1) {
+        tap_event_t release = *event;
+        release.sc.scancode = active->scancode;
+        release.usb_sc = combo->usb_sc;
+        feed_key(&release);
+      }
+      active->down &= ~(1 << i);
+      if (active->down == 0) {
+        *active = active_combos[--active_combo_count];
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void combo_feed(const tap_event_t *event) {
+  const uint8_t pos = event->sc.scancode;
+  if ((event->sc.flags & KEY_UP_MASK) ||
+      (combo_members[pos >> 5] & (1UL << (pos & 31))) == 0) {
+    // Pending keys went down before this one - they go first.
+    combo_resolve();
+    if ((event->sc.flags & KEY_UP_MASK) == 0 || !combo_release(event)) {
+      feed_key(event);
+    }
+    return;
+  }
+  if (combo_pending_count == 0) {
+    combo_deadline = event->time + config.comboWindow;
+  }
+  combo_pending[combo_pending_count++] = *event;
+  uint8_t exact;
+  const uint8_t candidates = combo_match(&exact);
+  if (candidates == 0) {
+    // No combo with this key and the pending ones. They go, it waits alone.
+    combo_pending_count--;
+    combo_resolve();
+    combo_pending[0] = *event;
+    combo_pending_count = 1;
+    combo_deadline = event->time + config.comboWindow;
+  } else if ((candidates == 1 && exact != COMBO_NONE) ||
+             combo_pending_count == MAX_COMBO_KEYS) {
+    combo_resolve();
+  }
+}
+
+// Pending keys wait no longer than config.comboWindow.
+inline void combo_tick(void) {
+  if (combo_pending_count > 0 && systime >= combo_deadline) {
+    combo_resolve();
+  }
+}
+
+bool reports_reset_pending;
+inline void process_real_key(void) {
+  if (reports_reset_pending && USBQUEUE_IS_EMPTY &&
+      macro_players_active == 0 && tap_buffered == 0 &&
+      combo_pending_count == 0) {
+    // ONLY reset if there are no pending USB events, playing macros,
+    // tap or combo keys - reset would cut them short.
+    // Scancodes are processed while waiting. A key pressed meanwhile calls
+    // the reset off - see below.
+    reset_reports();
+    serial_reset_reports();
+    reports_reset_pending = false;
+  }
+  tap_event_t event;
+  event.sc = read_scancode();
+  event.time = systime;
+  event.usb_sc = 0;
+  const scancode_t sc = event.sc;
+  if (sc.scancode != COMMONSENSE_NOKEY && (sc.flags & KEY_UP_MASK) == 0) {
+    // Not all keys are up anymore - that press must not be reset. Whatever
+    // was stuck gets its chance on the next "all keys up".
+    reports_reset_pending = false;
   }
-  scancode_t sc = read_scancode();
   if (sc.scancode == COMMONSENSE_NOKEY) {
     // An empty value. Likely because nothing was pressed last tick, but..
     if (sc.flags & KEY_UP_MASK) {
@@ -229,10 +821,10 @@ inline void process_real_key(void) {
       // which is not that bad - but first key is stuck forever.
       reports_reset_pending = true;
     }
-    if (tap_deadline == 0 || saved_macro_ptr != MACRO_NOT_FOUND) {
-      // not TapWait, not TapWait timeout either, no key.. Done!
-      return;
-    }
+    // No key, but combo or tap key may have timed out.
+    combo_tick();
+    tap_resolve();
+    return;
   }
   if (TEST_BIT(status_register, C2DEVSTATUS_SETUP_MODE)) {
     // In setup mode all scancodes(not USB!) go up the control channel, not HID.
@@ -244,101 +836,23 @@ inline void process_real_key(void) {
   }
 
   // OK, we're done with special cases. General scancode processing starts here.
-
-  // Resolve USB keycode using current active layers - drop down until defined.
-  uint8_t usb_sc = USBCODE_TRANSPARENT;
-  for (int8_t i = currentLayer; i >= 0; --i) {
-    usb_sc = config.layers[i][sc.scancode];
-#ifdef DEBUG_PIPELINE
-    xprintf("Lookup@%d: %02x %02x@L%d -> %d",
-            systime, sc.flags, sc.scancode, i, usb_sc);
-#endif
-    if (usb_sc != USBCODE_TRANSPARENT) {
-      break;
-    }
-  }
-  if (usb_sc == USBCODE_TRANSPARENT) {
-    // Empty key in layout from current layer down to base. Fuck no, DON'T EVER.
-    return;
-  }
-#ifdef DEBUG_PIPELINE
-  xprintf("SC@%d: %02x %02x@L%d -> %d",
-          systime, sc.flags, sc.scancode, currentLayer, usb_sc);
-#endif
-
-  uint8_t keyflags = sc.flags | USBQUEUE_REAL_KEY_MASK;
-  uint_fast16_t macro_ptr;
-  if (tap_deadline > 0) { // <TapWait>
-    // Tap wait mode. We are here because tap macro triggered on previous tick.
-    if (usb_sc == tap_usb_sc || sc.scancode == COMMONSENSE_NOKEY) {
-      // Ok, the key matches.
-      // Or it's a tap timeout - in which case we KIND OF have a second keyDown.
-      if (systime <= tap_deadline) {
-        // Quick enough. Play macro, eat keyUp, return to normal mode.
-#ifdef DEBUG_PIPELINE
-        xprintf("Tap@%d: %d", systime, saved_macro_ptr);
-#endif
-        play_macro(saved_macro_ptr);
-        tap_deadline = 0;
-        return; // Eat the keyUp by not queueing it.
-      }
-    }
-    // Ok, NOT a tap. Doesn't matter why, really. BUT there COULD HAVE BEEN
-    // a keyDown macro on that key. keyUp, too - but that we will process in a
-    // business-as-usual way.
-
-    // Flags override has a clowntown potential, I admit.
-    // Should probably save it from the keypress time, but naaah, wcgw.
-    // Also macro lookup is Special - it skips tap macros in TapWait mode.
-    macro_ptr = lookup_macro(USBQUEUE_REAL_KEY_MASK, tap_usb_sc);
-    if (macro_ptr == MACRO_NOT_FOUND) {
-      // Ugh.. Less-clowny way, just pretend we submitted the key a bit ago
-      queue_usbcode(tap_deadline - 120, USBQUEUE_REAL_KEY_MASK, tap_usb_sc);
-    } else {
-      // Play the keyDown, play it again, my Johnny..
-      play_macro(macro_ptr);
-    }
-    // And now back to normal processing of what's hopefully a keyDown.
-    tap_deadline = 0;
-    if (saved_macro_ptr == MACRO_NOT_FOUND) {
-      // Stop all the madness // stop clowntown // it's my life (c) Dr. Alban.
-      // Seriously though - this is special mode for TapWait timeout.
-      // There is no real key. Don't complicate downstream's life.
-      return;
-    }
-  } // </TapWait>
-  // Trick: FlightController must save tap macros before keyDown macros - so
-  // if both defined, we find tap first.
-  macro_ptr = lookup_macro(keyflags, usb_sc);
-  if (macro_ptr != MACRO_NOT_FOUND) {
-    if ((config.macros[macro_ptr + 1] & MACRO_TYPE_TAP) == 0) {
-      play_macro(macro_ptr);
-    } else {
-      // Tap macro cannot be selected for keyUp. So this must be keyDown.
-      // Enter the TapWait mode.
-      saved_macro_ptr = macro_ptr;
-      tap_usb_sc = usb_sc;
-      tap_deadline = systime + config.delayLib[DELAYS_TAP];
-    }
-    return;
-  }
-  // OK. Not macro.
-  // NOTE: queue_usbcode skips non-zero cells in the buffer. Think what to do
-  // on overflow.
-  // NOTE2: we still want to maintain order? Otherwise linked list is probably
-  // better (though expensive at 4B/pointer plus memory management)
-  queue_usbcode(systime, keyflags, usb_sc);
+  combo_tick();
+  combo_feed(&event);
+  tap_resolve();
 }
 
-#define NO_COOLDOWN USBQueue[pos].flags |= USBQUEUE_RELEASED_MASK;
 /*
-    Idea: not move readpos until keycode after it is processed.
-    So, readpos to writepos would be the working area.
+    Events go out in time order, see USBQueue. Everything due goes into one
+    report per endpoint - macros play at bus speed. Batch stops where host
+    would lose order:
+    - second event of the same key - press and release in one report is no
+      keypress at all;
+    - modifier after a regular key - it would apply to that key too;
+    - press from a macro after a real key press or the other way round -
+      keys typed after a tap key must not mix with its macro.
 
     TODO: maintain bitmap of currently pressed keys to release them on reset and
    for better KRO handling.
-    TODO: implement out of order key release?
-    NOTE ^ ^^ very rare situations where this is needed.
  */
 inline void update_reports(void) {
   if (cooldown_timer > 0) {
@@ -348,81 +862,75 @@ inline void update_reports(void) {
     cooldown_timer--;
     return;
   }
-  if (USBQUEUE_IS_EMPTY) {
-    return;
-  }
-  // If there's change - find first non-empty buffer cell.
-  // This results in infinite loop on empty buffer - must take care not to queue
-  // NOEVENTs.
-  while (USBQueue[USBQueue_rpos].keycode == USBCODE_NOEVENT) {
-    USBQueue_rpos = KEYCODE_BUFFER_NEXT(USBQueue_rpos);
-  }
-  // xprintf("USB queue %d - %d", USBQueue_rpos, USBQueue_wpos);
-  uint8_t pos = USBQueue_rpos;
-  do {
-    if (USBQueue[pos].keycode != USBCODE_NOEVENT &&
-        USBQueue[pos].sysTime <= systime) {
-      if (USBQueue[pos].keycode < USBCODE_A) {
-        // side effect - key transparent till the bottom will toggle exp. header
-        // But it should not ever be put on queue!
-        exp_toggle();
-        NO_COOLDOWN
-      }
-      // Codes you want filtered from reports MUST BE ABOVE THIS LINE!
-      // -> Think of special code for collectively settings mods!
-      else if (USBQueue[pos].keycode >= 0xe8) {
-        update_consumer_report(&USBQueue[pos]);
-      } else if (USBQueue[pos].keycode >= 0xa5 &&
-                 USBQueue[pos].keycode <= 0xa7) {
-        update_system_report(&USBQueue[pos]);
-      } else {
-        switch (output_direction) {
-          case OUTPUT_DIRECTION_USB:
-            update_keyboard_report(&USBQueue[pos]);
-            break;
-          case OUTPUT_DIRECTION_SERIAL:
-            update_serial_keyboard_report(&USBQueue[pos]);
-            break;
-          default:
-            break;
-        }
-
-      }
-      if ((USBQueue[pos].flags & USBQUEUE_RELEASED_MASK) == 0) {
-        // We only throttle keypresses. Key release doesn't slow us down -
-        // minimum duration is guaranteed by fact that key release goes after
-        // key press and keypress triggers cooldown.
-        cooldown_timer = config.delayLib[DELAYS_EVENT]; // Actual update
-                                                        // happened - reset
-                                                        // cooldown.
-        exp_keypress(
-            USBQueue[pos].keycode); // Let the downstream filter by keycode
+  uint32_t in_report[256 / 32] = {0};
+  bool keys_in_report = false;
+  bool pressed = false;
+  uint8_t press_source = 0; // USBQUEUE_REAL_KEY_MASK of presses in report.
+  while (!USBQUEUE_IS_EMPTY && USBQueue[0].sysTime <= systime) {
+    queuedScancode *key = &USBQueue[0];
+    const uint32_t key_bit = 1UL << (key->keycode & 31);
+    const bool mods_op = (key->flags & USBQUEUE_MODS_MASK) != 0;
+    const bool is_mod = (key->keycode & 0xf8) == 0xe0 || mods_op;
+    const bool is_press = (key->flags & USBQUEUE_RELEASED_MASK) == 0;
+    const uint8_t source = key->flags & USBQUEUE_REAL_KEY_MASK;
+    if ((in_report[key->keycode >> 5] & key_bit) ||
+        (is_mod && keys_in_report) ||
+        (is_press && pressed && source != press_source)) {
+      break;
+    }
+    if (is_press) {
+      press_source = source;
+    }
+    in_report[key->keycode >> 5] |= key_bit;
+    keys_in_report |= !is_mod;
+    if (mods_op) {
+      // Whole modifier byte at once. USB only - serial has no modifier byte.
+      if (output_direction == OUTPUT_DIRECTION_USB) {
+        update_keyboard_mods(key);
       }
-      USBQueue[pos].keycode = USBCODE_NOEVENT;
-      if (pos == USBQueue_rpos && pos != USBQueue_wpos) {
-        // Only if we're at first position. Previous cells may contain future
-        // actions otherwise! Also if not the last item - we don't want to
-        // overrun the buffer.
-        USBQueue_rpos = KEYCODE_BUFFER_NEXT(pos);
+    } else if (key->keycode < USBCODE_A) {
+      // side effect - key transparent till the bottom will toggle exp. header
+      // But it should not ever be put on queue!
+      exp_toggle();
+      key->flags |= USBQUEUE_RELEASED_MASK; // No cooldown.
+    }
+    // Codes you want filtered from reports MUST BE ABOVE THIS LINE!
+    else if (key->keycode >= 0xe8) {
+      update_consumer_report(key);
+    } else if (key->keycode >= 0xa5 && key->keycode <= 0xa7) {
+      update_system_report(key);
+    } else {
+      switch (output_direction) {
+        case OUTPUT_DIRECTION_USB:
+          update_keyboard_report(key);
+          break;
+        case OUTPUT_DIRECTION_SERIAL:
+          update_serial_keyboard_report(key);
+          break;
+        default:
+          break;
       }
-      break;
     }
-  } while (pos != USBQueue_wpos);
+    if ((key->flags & USBQUEUE_RELEASED_MASK) == 0) {
+      pressed = true;
+      exp_keypress(key->keycode); // Let the downstream filter by keycode
+    }
+    dequeue_usbcode();
+  }
+  usb_flush_reports();
+  if (pressed) {
+    // We only throttle keypresses. Key release doesn't slow us down -
+    // minimum duration is guaranteed by fact that key release goes after
+    // key press and keypress triggers cooldown.
+    cooldown_timer = config.delayLib[DELAYS_EVENT]; // Actual update
+                                                    // happened - reset
+                                                    // cooldown.
+  }
 }
 
 inline void pipeline_process(void) {
-  if (false) {
-    /*
-            playing non-game macro
-                if wait is blocking:
-                    if SCB has macro SC release:
-                        set that SCB pos to 0
-                        play after-wait part of macro to USBCB w/proper
-       timestamps
-    */
-  } else {
-    process_real_key();
-  }
+  process_real_key();
+  run_macros();
   update_reports();
 }
 
@@ -436,9 +944,14 @@ void pipeline_init(void) {
   // Pipeline is worked on in main loop only, no point disabling IRQs to avoid
   // preemption.
   scan_reset();
-  USBQueue_rpos = 0;
-  USBQueue_wpos = 0;
+  build_keymap();
+  build_macro_index();
+  build_combos();
+  macro_players_active = 0;
+  macros_dropped = 0;
+  USBQueue_length = 0;
+  USBQueue_dropped = 0;
   cooldown_timer = 0;
-  memset(USBQueue, USBCODE_NOEVENT, sizeof USBQueue);
   saved_macro_ptr = MACRO_NOT_FOUND;
+  tap_buffered = 0;
 }
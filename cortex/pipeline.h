@@ -16,8 +16,14 @@ typedef union {
     uint32_t sysTime;
     uint8_t flags;
     uint8_t keycode;
+    // USBQUEUE_MODS_MASK: modifiers PushMods sets, see queue_mods.
+    uint8_t mods;
+    // scancode_t.detected of the key that caused it, 0 for macros.
+    uint32_t detected;
+    // Queueing order - events due at the same time go out in it.
+    uint32_t seq;
   } __attribute__((packed));
-  uint8_t raw[6];
+  uint8_t raw[15];
 } queuedScancode;
 
 #define USBCODE_TRANSPARENT 0
@@ -28,20 +34,47 @@ typedef union {
 
 #define USBQUEUE_RELEASED_MASK 0x80
 #define USBQUEUE_REAL_KEY_MASK 0x40
+// Mods stack operation from macro, macroModsOp in USBQUEUE_MODS_OP bits.
+// Keycode is USBCODE_TRANSPARENT - no key or macro step can queue that.
+#define USBQUEUE_MODS_MASK 0x20
+#define USBQUEUE_MODS_OP 0x03
 
-#define KEYCODE_BUFFER_END 63
-#define KEYCODE_BUFFER_NEXT(X) ((X + 1) & KEYCODE_BUFFER_END)
-#define KEYCODE_BUFFER_PREV(X) ((X + KEYCODE_BUFFER_END) & KEYCODE_BUFFER_END)
-// ^^^ THIS MUST EQUAL 2^n-1!!! Used as bitmask.
+/*
+ * Pending HID events, binary min-heap on (sysTime, seq).
+ * USBQueue[0] is the next one due. When full, new events are dropped
+ * and counted in status reply - "all keys up" reset unsticks whatever that
+ * leaves. Count restarts with pipeline_init.
+ */
+#define USBQUEUE_SIZE 64
 
 #define MACRO_NOT_FOUND UINT_FAST16_MAX
 #define MACRO_KEY_UPDOWN_RELEASE 0x02
+#define USBCODE_LEFT_SHIFT 0xe1
+
+queuedScancode USBQueue[USBQUEUE_SIZE];
+uint8_t USBQueue_length;
+uint32_t USBQueue_seq;
+uint16_t USBQueue_dropped;
+#define USBQUEUE_IS_EMPTY (USBQueue_length == 0)
 
-queuedScancode USBQueue[KEYCODE_BUFFER_END + 1];
-uint8_t USBQueue_rpos;
-uint8_t USBQueue_wpos;
-#define USBQUEUE_IS_EMPTY (USBQueue_rpos == USBQueue_wpos &&                   \
-                           USBQueue[USBQueue_rpos].keycode == USBCODE_NOEVENT)
+/*
+ * Playing macros, see play_macro. When all players are busy, new macros are
+ * dropped and counted in status reply, until pipeline_init.
+ */
+#define MAX_PLAYING_MACROS 4
+typedef struct {
+  uint16_t pc;  // Next command, offset in config.macros.
+  uint16_t end; // First byte past the macro.
+  uint32_t due; // When next command runs.
+  uint8_t string_left;  // Characters of TypeString still to go.
+  uint8_t string_delay; // delayLib index of TypeString.
+  bool string_shift;    // TypeString holds shift.
+  uint32_t started;     // systime when it started.
+  uint32_t detected;    // Trigger key's scancode_t.detected, see macro_queue.
+} macro_player_t;
+macro_player_t macro_players[MAX_PLAYING_MACROS];
+uint8_t macro_players_active;
+uint16_t macros_dropped;
 
 uint8_t mods;
 uint8_t layerMods;
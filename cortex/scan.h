@@ -14,8 +14,10 @@ typedef union {
   struct {
     uint8_t flags;
     uint8_t scancode;
+    // DWT_CYCCNT_REG when the event was appended. Never 0.
+    uint32_t detected;
   } __attribute__((packed));
-  uint8_t raw[2];
+  uint8_t raw[6];
 } scancode_t;
 
 // number of ticks to check for spam after scan starts
@@ -34,18 +36,63 @@ typedef union {
 #define DEBUG_SHOW_MATRIX_EVENTS 0
 #define PROFILE_SCAN_PROCESSING 0
 
-#define SCANCODES_END 31
-#define SCANCODES_NEXT(X) ((X + 1) & SCANCODES_END)
-// ^^^ THIS MUST EQUAL 2^n-1!!! Used as bitmask.
+// Define VERTICAL_DEBOUNCING in config.h to debounce with bit-sliced vertical
+// counters instead of per-key shift registers - whole row in a few logical ops.
+// Same debouncingTicks meaning, 1 is "no debouncing".
+// matrix[] then only holds raw readouts for the matrix monitor.
 
-scancode_t scancodes[SCANCODES_END + 1];
-uint8_t scancodes_wpos;
-uint8_t scancodes_rpos;
+/*
+ * Scancode ring. Scanner ISRs produce, pipeline consumes in the main loop.
+ * Main loop producers (scan_check_matrix) must lock out the scanner.
+ * Writer owns wpos - next slot to fill. Reader owns rpos - next slot to read.
+ * Empty when they are equal, full when wpos is one behind rpos, so ring holds
+ * SCANCODES_SIZE - 1 events. When full, new events are dropped and counted -
+ * see C2RESPONSE_STATUS.
+ * Override SCANCODES_SIZE in config.h - 2^n, 256 max.
+ */
+#ifndef SCANCODES_SIZE
+#define SCANCODES_SIZE 32
+#endif
+#if (SCANCODES_SIZE & (SCANCODES_SIZE - 1)) || SCANCODES_SIZE > 256
+#error SCANCODES_SIZE must be a power of 2, 256 max
+#endif
+#define SCANCODES_NEXT(X) (((X) + 1) & (SCANCODES_SIZE - 1))
+#define SCANCODES_USED() ((scancodes_wpos - scancodes_rpos) & (SCANCODES_SIZE - 1))
+
+scancode_t scancodes[SCANCODES_SIZE];
+volatile uint8_t scancodes_wpos;
+volatile uint8_t scancodes_rpos;
+// Since scan_init. Saturate.
+uint16_t scancodes_dropped;
+uint8_t scancodes_high_water;
 
 void append_scancode(uint8_t flags, uint8_t scancode);
 void append_debounced(uint8_t flags, uint8_t scancode);
+void append_debounced_row(uint8_t row, uint32_t pressed);
 void scan_set_matrix_value(uint8_t keyIndex, uint16_t value);
 void report_matrix_readouts();
+// Per-key bounce counters and shortest presses, see C2RESPONSE_KEY_STATS.
+void report_key_stats(bool clear);
+void scan_clear_key_stats(void);
+
+// Telemetry, see telemetry_t. Scanner counts full passes and ISR cycles.
+volatile uint16_t scan_passes;
+telemetry_t telemetry;
+void scan_count_cycles(uint8_t isr, uint32_t cycles);
+void report_telemetry(void);
+
+// Set by scanners that can tell cheaply that a key may be down in USB suspend
+// (see wake scan in scan_capsense.c). Main loop then runs full passes back to
+// back instead of one every SUSPEND_SYSTIMER_DIVISOR ticks.
+volatile bool scan_wake_pending;
+
+// Raw sample capture, see C2CMD_CAPTURE_KEY. Scanner feeds every readout of
+// the key at capture_row/capture_col to capture_sample while capture runs.
+#define CAPTURE_NO_ROW 0xff
+uint8_t capture_row;
+uint8_t capture_col;
+void capture_sample(uint16_t value);
+void scan_capture_arm(uint8_t keyIndex, uint8_t trigger, uint16_t level);
 
 void scan_check_matrix();
 bool scan_is_key_down(uint8_t keyIndex);
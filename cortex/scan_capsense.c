@@ -10,11 +10,22 @@
 
 #include "scan.h"
 
-// This is to ease calculations, there are things hardcoded in buffer
-// management!! For 1 and 2 ADCs, that is.
+// Number of SAR ADCs converting columns in parallel. Set it in config.h -
+// TopDesign must have ADC1 and Buf1 DMA for 2 ADCs.
+#ifndef NUM_ADCs
 #define NUM_ADCs 1
+#endif
 
-#define ADC_CHANNELS (MATRIX_COLS / NUM_ADCs)
+#if NUM_ADCs != 1 && NUM_ADCs != 2
+#error only 1 and 2 ADCs are supported
+#endif
+
+// Columns are split into contiguous blocks, one per ADC: ADC0 gets columns
+// 0..ADC_CHANNELS-1, ADC1 gets the rest. If columns don't split evenly, the
+// last ADC has phantom channels at the top of its block. Phantom MUX inputs
+// must be tied to ground - they are converted, but never looked at.
+#define ADC_CHANNELS ((MATRIX_COLS + NUM_ADCs - 1) / NUM_ADCs)
+#define ADC_PHANTOM_CHANNELS (ADC_CHANNELS * NUM_ADCs - MATRIX_COLS)
 
 // Should be [number of columns per ADC + 1] * 2 + 1 - so 19 for MF, 27 for BS
 // TRICKY PART: Count7(which is part of PTK) counts down.
@@ -29,12 +40,44 @@
 
 // Below is per ADC.
 #define ADC_BUFFER_BYTESIZE (PTK_CHANNELS * 2)
+// Every column takes 4 bytes: grounded sample, then column sample.
+#define ADC_RESULTS_BYTESIZE (ADC_CHANNELS * 4)
+
+#if ADC_RESULTS_BYTESIZE > 127
+#error DMA burst is limited to 127 bytes - too many columns per ADC
+#endif
+
+// Whole row of readouts, all ADCs.
+#define RESULTS_ROW_BYTESIZE (ADC_RESULTS_BYTESIZE * NUM_ADCs)
 
-// Don't forget to set PTK to 5 channels for 100kHz mode!
-// 3 channels is too low - pulse reset logic activates at ch2 selection
-// Not good, 2 being the first channel in 3-channel config!
-// PTK calibration: 5 = 114kHz, 7 - 92kHz, 15 - 52kHz
-#undef COMMONSENSE_100KHZ_MODE
+/*
+ * High-rate mode. Define COMMONSENSE_100KHZ_MODE in config.h to enable.
+ * Rows are advanced by RowDrive DMA feeding DriveReg0 from a table, readouts
+ * are moved into a frame by FinalBuf DMA - no CPU involvement per row.
+ * Result_ISR runs once per full pass and debounces the whole frame.
+ * TopDesign requirements:
+ *  - RowDrive DMA component;
+ *  - FinalBuf and RowDrive DRQs wired to the EoC line (nrq of Buf0);
+ *  - EoCIRQ is not used, EoC telemetry stays 0.
+ * Since each key is sampled once per pass, raise debouncingTicks to spend
+ * the extra passes on noise immunity - latency stays the same.
+ *
+ * Don't forget to set PTK to 5 channels for 100kHz mode!
+ * 3 channels is too low - pulse reset logic activates at ch2 selection
+ * Not good, 2 being the first channel in 3-channel config!
+ * PTK calibration: 5 = 114kHz, 7 - 92kHz, 15 - 52kHz
+ */
+#ifdef COMMONSENSE_100KHZ_MODE
+// Two frames, so one can be debounced while DMA fills the other.
+#define RESULT_FRAMES 2
+#define ROWS_PER_RESULT_IRQ MATRIX_ROWS
+#else
+#define RESULT_FRAMES 1
+#define ROWS_PER_RESULT_IRQ 1
+#endif
+// FinalBuf TD ring is RESULT_STEPS rows long, NUM_ADCs TDs per row.
+#define RESULT_STEPS (RESULT_FRAMES * ROWS_PER_RESULT_IRQ)
+#define RESULT_TDS (RESULT_STEPS * NUM_ADCs)
 
 
 CY_ISR_PROTO(EoC_ISR);
@@ -42,22 +85,198 @@ CY_ISR_PROTO(Result_ISR);
 
 uint8_t Buf0TD = CY_DMA_INVALID_TD;
 uint8_t Buf1TD = CY_DMA_INVALID_TD;
-uint8_t FinalBufTD[2];
+uint8_t FinalBufTD[RESULT_TDS] = {[0 ... RESULT_TDS - 1] = CY_DMA_INVALID_TD};
 uint16_t BufMem[PTK_CHANNELS * NUM_ADCs];
 
+// Blocks are stored highest ADC first, so readouts go from the last column
+// to the first one - Result_ISR walks this linearly.
+// In high-rate mode rows go from the last one to the first one, too.
 // We're only using low 8 bit of ADC output, but ADC gets us 16 and then 
-uint8_t Results[ADC_CHANNELS * 4 * NUM_ADCs];
+uint8_t Results[RESULT_STEPS][RESULTS_ROW_BYTESIZE];
 
 uint8_t reading_row, driving_row;
 bool scan_in_progress;
 
+/*
+ * Rows and columns where every key is K_IGNORE_KEY are not scanned.
+ * Rows are skipped when driving. Columns can only be cut from the top of
+ * every ADC block - that's the start of the PTK sequence, so channel count
+ * and DMA lengths shrink. Columns in the middle are still converted.
+ * Buffers keep their full size, so any layout fits.
+ * Matrix monitor, setup mode and key capture want ignored keys too - whole
+ * matrix is scanned while any of them is on, see scan_layout_tick.
+ */
+static uint8_t active_channels;      // Per ADC, from the bottom of the block.
+static uint16_t active_rows;         // Bitmask.
+static uint8_t active_row_count;
+static uint8_t active_row_list[MATRIX_ROWS]; // In scan order - last row first.
+static uint8_t ptk_channels;
+static uint8_t adc_results_bytesize;
+static uint8_t active_col_count;
+static bool full_layout;
+
+/*
+ * Scan governor. After config.governorIdle seconds with no key over
+ * threshold, the gap between rows (DischargeDelay) doubles - and doubles
+ * again every next idle period, up to config.governorSteps times. First
+ * sample over threshold restores the full rate right from Result_ISR, so
+ * the press that woke the scanner waits for one slow pass at most.
+ * Matrix monitor and key capture keep the full rate.
+ */
+// Same limit FlightController puts on discharge delay.
+#define GOVERNOR_MAX_GAP 65533u
+static volatile uint8_t governor_step; // 0 - full rate.
+static volatile bool governor_activity;
+static uint32_t governor_idle_ticks;
+
+static inline void governor_set_step(uint8_t step) {
+  uint32_t gap = (uint32_t)config.dischargeDelay << step;
+  if (gap > GOVERNOR_MAX_GAP) {
+    gap = GOVERNOR_MAX_GAP;
+  }
+  // Takes effect at the next reload - row in flight keeps its gap.
+  DischargeDelay_WritePeriod(gap);
+  governor_step = step;
+}
+
+// Called from Result_ISR on every row with keys over threshold.
+static inline void governor_wake(void) {
+  governor_activity = true;
+  if (governor_step) {
+    governor_set_step(0);
+  }
+}
+
+static void governor_tick(void) {
+  if (governor_activity || config.governorSteps == 0
+      || TEST_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR)
+      || capture_row != CAPTURE_NO_ROW) {
+    governor_activity = false;
+    governor_idle_ticks = 0;
+    if (governor_step) {
+      // Monitor or capture turned on - don't wait for a keypress.
+      uint8_t enableInterrupts = CyEnterCriticalSection();
+      governor_set_step(0);
+      CyExitCriticalSection(enableInterrupts);
+    }
+    return;
+  }
+  if (governor_step >= config.governorSteps
+      || ++governor_idle_ticks < config.governorIdle * 1000u) {
+    return;
+  }
+  governor_idle_ticks = 0;
+  uint8_t enableInterrupts = CyEnterCriticalSection();
+  // Result_ISR may have seen a key since the check above.
+  if (!governor_activity) {
+    governor_set_step(governor_step + 1);
+  }
+  CyExitCriticalSection(enableInterrupts);
+}
+
+#ifndef COMMONSENSE_100KHZ_MODE
+/*
+ * Wake scan. In USB suspend scan_start doesn't run the whole matrix - it
+ * drives groups of config.wakeRows rows together and converts every group
+ * once. Keys driven together add up on their column, so a key going down
+ * moves the column aggregate away from the idle baseline.
+ * First pass after suspend learns the baseline, later passes let it follow
+ * idle level down (up for normally high). Once some column moves past it by
+ * more than config.wakeMargin, scan_wake_pending makes main loop run
+ * WAKE_FULL_PASSES normal passes, so debouncing and pipeline see the key.
+ * If those didn't wake the host, baseline is learned again.
+ * MatrixMonitor "Wake model" checks margins against matrix stats files.
+ * Not in high-rate mode - RowDrive DMA owns the row sequence there.
+ */
+#define WAKE_FULL_PASSES (MAX_DEBOUNCING_BUFFER_SIZE + 1)
+// First readout after start is unreliable (see scan_start), so group 0 is
+// converted twice. driving_row counts groups from here and wraps to 0.
+#define WAKE_PRIMING 0xff
+static uint8_t wake_groups[MATRIX_ROWS]; // DriveReg0 values.
+static uint8_t wake_group_count;         // 0 - wake scan is off.
+static uint16_t wake_baseline[MATRIX_ROWS][MATRIX_COLS];
+static bool wake_baseline_valid;
+static volatile bool wake_pass;
+static uint8_t wake_full_passes;
+#endif
+
+#ifdef COMMONSENSE_100KHZ_MODE
+uint8_t RowDriveTD = CY_DMA_INVALID_TD;
+// DriveReg0 values in the order RowDrive feeds them. See RowDriveSetup.
+uint8_t row_drive_sequence[MATRIX_ROWS];
+uint8_t reading_frame;
+#define ACTIVE_ROWS_PER_IRQ active_row_count
+#else
+#define ACTIVE_ROWS_PER_IRQ 1
+#endif
+
+static void find_active_keys(void) {
+  active_rows = 0;
+  active_channels = 0;
+  uint8_t keyIndex = 0;
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++, keyIndex++) {
+      if (config.thresholds[keyIndex] == K_IGNORE_KEY) {
+        continue;
+      }
+      SET_BIT(active_rows, row);
+      if (col % ADC_CHANNELS >= active_channels) {
+        active_channels = col % ADC_CHANNELS + 1;
+      }
+    }
+  }
+  if (active_rows == 0 || full_layout) {
+    // Nothing to scan - but scanner still has to run, so scan everything.
+    active_rows = (1 << MATRIX_ROWS) - 1;
+    active_channels = ADC_CHANNELS;
+  }
+  active_row_count = 0;
+  for (int8_t row = MATRIX_ROWS - 1; row >= 0; row--) {
+    if (TEST_BIT(active_rows, row)) {
+      active_row_list[active_row_count++] = row;
+    }
+  }
+  active_col_count = 0;
+  for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+    if (col % ADC_CHANNELS < active_channels) {
+      active_col_count++;
+    }
+  }
+  ptk_channels = 2 * active_channels + 3;
+  adc_results_bytesize = active_channels * 4;
+#ifndef COMMONSENSE_100KHZ_MODE
+  wake_group_count = 0;
+  wake_baseline_valid = false;
+  if (config.wakeRows) {
+    for (uint8_t i = 0; i < active_row_count; i++) {
+      if (i % config.wakeRows == 0) {
+        wake_groups[wake_group_count++] = 0;
+      }
+      wake_groups[wake_group_count - 1] |= 1 << active_row_list[i];
+    }
+  }
+#endif
+}
+
+// Where readout of the column is in the results row. NULL if not converted.
+static inline const uint8_t *column_readout(const uint8_t *results,
+                                            uint8_t col) {
+  const uint8_t adc = col / ADC_CHANNELS;
+  const uint8_t channel = col % ADC_CHANNELS;
+  if (channel >= active_channels) {
+    return NULL;
+  }
+  return &results[((NUM_ADCs - 1 - adc) * active_channels + active_channels -
+                   1 - channel) * 4];
+}
+
 void BufferSetup(uint8 chan, uint8 *td, uint8 channel_config,
                         uint32 src_addr, uint32 dst_addr) {
   (void)CyDmaClearPendingDrq(chan);
   if (*td == CY_DMA_INVALID_TD)
     *td = CyDmaTdAllocate();
   // transferCount is actually bytes, not transactions.
-  (void)CyDmaTdSetConfiguration(*td, (uint16)ADC_BUFFER_BYTESIZE, *td,
+  (void)CyDmaTdSetConfiguration(*td, (uint16)(ptk_channels * 2), *td,
                                 (channel_config | (uint8)TD_INC_DST_ADR));
   (void)CyDmaTdSetAddress(*td, LO16(src_addr), LO16(dst_addr));
   (void)CyDmaChSetInitialTd(chan, *td);
@@ -65,39 +284,69 @@ void BufferSetup(uint8 chan, uint8 *td, uint8 channel_config,
 }
 
 void ResultBufferSetup(void) {
+  CyDmaChDisable(FinalBuf_DmaHandle);
   CyDmaClearPendingDrq(FinalBuf_DmaHandle);
-  FinalBufTD[0] = CyDmaTdAllocate();
-#if NUM_ADCs == 1
-  CyDmaTdSetConfiguration(
-      FinalBufTD[0], (uint16)(sizeof Results), FinalBufTD[0],
-      CY_DMA_TD_INC_SRC_ADR | CY_DMA_TD_INC_DST_ADR | FinalBuf__TD_TERMOUT_EN);
-  CyDmaTdSetAddress(FinalBufTD[0],
-                    LO16((uint32)&BufMem[ADC_BUF_INITIAL_OFFSET]),
-                    LO16((uint32)&Results));
-#elif NUM_ADCs == 2
-  FinalBufTD[1] = CyDmaTdAllocate();
-  // transferCount is actually bytes, not transactions.
-  CyDmaTdSetConfiguration(
-      FinalBufTD[0], (uint16)(sizeof Results / NUM_ADCs), FinalBufTD[1],
-      CY_DMA_TD_INC_SRC_ADR | CY_DMA_TD_INC_DST_ADR | CY_DMA_TD_AUTO_EXEC_NEXT);
-  CyDmaTdSetAddress(FinalBufTD[0],
-                    LO16((uint32)&BufMem[ADC_BUF_INITIAL_OFFSET]),
-                    LO16((uint32)&Results));
-  CyDmaTdSetConfiguration(
-      FinalBufTD[1], (uint16)(sizeof Results / NUM_ADCs), FinalBufTD[0],
-      CY_DMA_TD_INC_SRC_ADR | CY_DMA_TD_INC_DST_ADR | FinalBuf__TD_TERMOUT_EN);
-  CyDmaTdSetAddress(
-      FinalBufTD[1],
-      LO16((uint32)&BufMem[PTK_CHANNELS + ADC_BUF_INITIAL_OFFSET]),
-      LO16((uint32)&Results[ADC_CHANNELS * 2]));
-#else
-#error only 1 and 2 ADCs are supported
-#endif
+  for (uint8_t i = 0; i < RESULT_TDS; i++) {
+    if (FinalBufTD[i] == CY_DMA_INVALID_TD) {
+      FinalBufTD[i] = CyDmaTdAllocate();
+    }
+  }
+  // TDs form a ring, one request per row. Within the row every TD but the
+  // last one immediately executes the next, so one request moves all ADC
+  // blocks. Last TD of the last row before Result_ISR is due raises ResultIRQ.
+  // Skipped rows are not in the ring.
+  const uint8_t steps = RESULT_FRAMES * ACTIVE_ROWS_PER_IRQ;
+  const uint8_t tds = steps * NUM_ADCs;
+  uint8_t td = 0;
+  for (uint8_t step = 0; step < steps; step++) {
+    const bool irq = (step % ACTIVE_ROWS_PER_IRQ == ACTIVE_ROWS_PER_IRQ - 1);
+    for (uint8_t adc = 0; adc < NUM_ADCs; adc++, td++) {
+      const bool last = (adc == NUM_ADCs - 1);
+      uint8_t flags = CY_DMA_TD_INC_SRC_ADR | CY_DMA_TD_INC_DST_ADR;
+      if (!last) {
+        flags |= CY_DMA_TD_AUTO_EXEC_NEXT;
+      } else if (irq) {
+        flags |= FinalBuf__TD_TERMOUT_EN;
+      }
+      // transferCount is actually bytes, not transactions.
+      CyDmaTdSetConfiguration(FinalBufTD[td], (uint16)adc_results_bytesize,
+                              FinalBufTD[(td + 1) % tds], flags);
+      CyDmaTdSetAddress(
+          FinalBufTD[td],
+          LO16((uint32)&BufMem[adc * PTK_CHANNELS + ADC_BUF_INITIAL_OFFSET]),
+          LO16((uint32)&Results[step][(NUM_ADCs - 1 - adc) *
+                                      adc_results_bytesize]));
+    }
+  }
   CyDmaChSetInitialTd(FinalBuf_DmaHandle, FinalBufTD[0]);
   CyDmaChEnable(FinalBuf_DmaHandle, 1);
 }
 
+#ifdef COMMONSENSE_100KHZ_MODE
+void RowDriveSetup(void) {
+  // scan_start drives the last row by hand, so DMA continues from the one
+  // before it and wraps around: R-2, R-3 .. 0, R-1. Skipped rows are left out.
+  for (uint8_t i = 0; i < active_row_count; i++) {
+    row_drive_sequence[i] =
+        1 << active_row_list[(i + 1) % active_row_count];
+  }
+  CyDmaChDisable(RowDrive_DmaHandle);
+  CyDmaClearPendingDrq(RowDrive_DmaHandle);
+  if (RowDriveTD == CY_DMA_INVALID_TD) {
+    RowDriveTD = CyDmaTdAllocate();
+  }
+  // One byte per request, loops over the table forever.
+  CyDmaTdSetConfiguration(RowDriveTD, active_row_count, RowDriveTD,
+                          CY_DMA_TD_INC_SRC_ADR);
+  CyDmaTdSetAddress(RowDriveTD, LO16((uint32)row_drive_sequence),
+                    LO16((uint32)DriveReg0_Control_PTR));
+  CyDmaChSetInitialTd(RowDrive_DmaHandle, RowDriveTD);
+  CyDmaChEnable(RowDrive_DmaHandle, 1);
+}
+#endif
+
 void sensor_init() {
+  find_active_keys();
   // Init DMA, each burst requires a request
   Buf0_DmaInitialize(sizeof BufMem[0], 1, (uint16)(HI16(CYDEV_PERIPH_BASE)),
                      (uint16)(HI16(CYDEV_SRAM_BASE)));
@@ -105,14 +354,18 @@ void sensor_init() {
   Buf1_DmaInitialize(sizeof BufMem[0], 1, (uint16)(HI16(CYDEV_PERIPH_BASE)),
                      (uint16)(HI16(CYDEV_SRAM_BASE)));
 #endif
-  // 1 request per ADC, get the whole ADC buffer (skip grounded channels which
-  // are at the end).
-  FinalBuf_DmaInitialize(sizeof Results / NUM_ADCs, NUM_ADCs,
+  // One burst per ADC block, one request per row - TDs chain the rest.
+  // Grounded channels at the end of ADC buffer are skipped.
+  FinalBuf_DmaInitialize(adc_results_bytesize, 1,
                          (uint16)(HI16(CYDEV_SRAM_BASE)),
                          (uint16)(HI16(CYDEV_SRAM_BASE)));
+#ifdef COMMONSENSE_100KHZ_MODE
+  RowDrive_DmaInitialize(1, 1, (uint16)(HI16(CYDEV_SRAM_BASE)),
+                         (uint16)(HI16(CYDEV_PERIPH_BASE)));
+#endif
   uint8 enableInterrupts = CyEnterCriticalSection();
   (*(reg8 *)PTK_ChannelCounter__PERIOD_REG) =
-      (PTK_CHANNELS -
+      (ptk_channels -
        1); // Load number of channels. See Count7/WritePeriod for details.
   (*(reg8 *)PTK_ChannelCounter__CONTROL_AUX_CTL_REG) |=
       (uint8)0x20u; // Init count7
@@ -126,13 +379,15 @@ void sensor_init() {
   ChargeDelay_Start();
   ChargeDelay_WritePeriod(config.chargeDelay);
   DischargeDelay_Start();
-  DischargeDelay_WritePeriod(config.dischargeDelay);
+  governor_set_step(0);
+  governor_activity = false;
+  governor_idle_ticks = 0;
 
   BufferSetup(Buf0_DmaHandle, &Buf0TD, Buf0__TD_TERMOUT_EN,
               (uint32)ADC0_ADC_SAR__WRK0, (uint32)BufMem);
 #if NUM_ADCs > 1
   BufferSetup(Buf1_DmaHandle, &Buf1TD, Buf1__TD_TERMOUT_EN,
-              (uint32)ADC1_ADC_SAR__WRK0, ADC_BUFFER_BYTESIZE + (uint32)BufMem);
+              (uint32)ADC1_ADC_SAR__WRK0, (uint32)&BufMem[PTK_CHANNELS]);
 #endif
   ResultBufferSetup();
   (*(reg8 *)PTK_CtrlReg__CONTROL_REG) =
@@ -141,17 +396,25 @@ void sensor_init() {
   // so we don't start fetching next buffer before we are done with the current
   // one.
   ResultIRQ_StartEx(Result_ISR);
+#ifndef COMMONSENSE_100KHZ_MODE
   EoCIRQ_StartEx(EoC_ISR);
+#endif
 }
 
 void sensor_nap(void) {
   ChargeDelay_Sleep();
   DischargeDelay_Sleep();
   ADC0_Sleep();
+#if NUM_ADCs > 1
+  ADC1_Sleep();
+#endif
 }
 
 void sensor_wake(void) {
   ADC0_Wakeup();
+#if NUM_ADCs > 1
+  ADC1_Wakeup();
+#endif
   DischargeDelay_Wakeup();
   ChargeDelay_Wakeup();
 }
@@ -168,21 +431,28 @@ static inline void Drive(uint8 drv) {
 }
 
 CY_ISR(EoC_ISR) {
+  const uint32_t isr_start = DWT_CYCCNT_REG;
 #ifdef DEBUG_INTERRUPTS
   PIN_DEBUG(1, 1)
 #endif
 // If there's no scan in progress - one row will be filled by garbage.
 // Which is no big deal.
-#ifdef COMMONSENSE_100KHZ_MODE
-  Drive(0);
-  return;
-// The rest of the code is dead in 100kHz mode.
-#endif
   CyDmaChSetRequest(FinalBuf_DmaHandle, CY_DMA_CPU_REQ);
   uint8_t enableInterrupts = CyEnterCriticalSection();
   reading_row = driving_row;
-  if (0 == driving_row) {
+#ifndef COMMONSENSE_100KHZ_MODE
+  if (wake_pass) {
+    if (++driving_row < wake_group_count) {
+      DriveReg0_Write(wake_groups[driving_row]);
+    } else {
+      scan_in_progress = false;
+    }
+    goto EoC_final;
+  }
+#endif
+  if (active_row_list[active_row_count - 1] == driving_row) {
     // End of the scan pass. Loop if full throttle, otherwise stop.
+    scan_passes++;
     if (power_state != DEVSTATE_FULL_THROTTLE
         || 0 == TEST_BIT(status_register, C2DEVSTATUS_SCAN_ENABLED)) {
       scan_in_progress = false;
@@ -190,7 +460,10 @@ CY_ISR(EoC_ISR) {
     }
     driving_row = MATRIX_ROWS;
   }
-  driving_row--;
+  // Skip rows with no keys. There's always one - pass ends at the lowest.
+  do {
+    driving_row--;
+  } while (!TEST_BIT(active_rows, driving_row));
   // Drive row.
   // DMA channel reading out results has priority, so this should not overwrite
   // the results buffer.
@@ -198,59 +471,208 @@ CY_ISR(EoC_ISR) {
 
 EoC_final:
   CyExitCriticalSection(enableInterrupts);
+  scan_count_cycles(TELEMETRY_ISR_EOC, DWT_CYCCNT_REG - isr_start);
 }
 
-CY_ISR(Result_ISR) {
-#ifdef DEBUG_INTERRUPTS
-  PIN_DEBUG(1, 2)
-#endif
-#ifdef COMMONSENSE_100KHZ_MODE
-  return;
-// The rest of the code is dead in 100kHz mode.
+#ifndef COMMONSENSE_100KHZ_MODE
+static inline void wake_process_group(const uint8_t *results, uint8_t group) {
+  uint16_t *baseline = wake_baseline[group];
+  for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+    const uint8_t *readout = column_readout(results, col);
+    if (!readout) {
+      continue;
+    }
+    const uint16_t level = readout[0] | (readout[1] << 8);
+    if (!wake_baseline_valid) {
+      baseline[col] = level;
+      continue;
+    }
+#if NORMALLY_LOW == 1
+    if (level < baseline[col]) {
+      baseline[col] = level;
+    } else if (level - baseline[col] > config.wakeMargin) {
+      scan_wake_pending = true;
+    }
+#else
+    if (level > baseline[col]) {
+      baseline[col] = level;
+    } else if (baseline[col] - level > config.wakeMargin) {
+      scan_wake_pending = true;
+    }
 #endif
-  int8_t adc_buffer_pos = -4;
-  // keyIndex - same speed as static global on -O3, faster in -Os
-  // having uint16_t* for cell is slower than directly using matrix[keyIndex].
-  uint8_t keyIndex = (reading_row + 1) * MATRIX_COLS;
-  // caching row status is faster than direct access, but common functions..
-#if PROFILE_SCAN_PROCESSING == 1
-  CyPins_SetPin(ExpHdr_1);
+  }
+  if (group == wake_group_count - 1) {
+    wake_baseline_valid = true;
+  }
+}
+
+// Starts wake pass instead of the full one when it's time. See above.
+static bool wake_scan_start(void) {
+  if (power_state == DEVSTATE_FULL_THROTTLE || wake_group_count == 0) {
+    // Learn baseline anew at the next suspend.
+    wake_baseline_valid = false;
+    scan_wake_pending = false;
+    wake_pass = false;
+    return false;
+  }
+  if (scan_wake_pending) {
+    wake_pass = false;
+    if (--wake_full_passes == 0) {
+      // Host wasn't woken - drift or ignored key, relearn.
+      scan_wake_pending = false;
+      wake_baseline_valid = false;
+    }
+    return false;
+  }
+  wake_full_passes = WAKE_FULL_PASSES;
+  wake_pass = true;
+  driving_row = WAKE_PRIMING;
+  DriveReg0_Write(wake_groups[0]);
+  scan_in_progress = true;
+  return true;
+}
 #endif
-  for (int8_t curCol = ADC_CHANNELS * NUM_ADCs - 1; curCol >= 0; curCol--) {
-    adc_buffer_pos += 4;
-    // TEST_BIT is faster than bool inited outside of the loop.
-    if (TEST_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR)) {
+
+static inline void process_row(const uint8_t *results, uint8_t row) {
+  const uint8_t *readout = results;
+  const uint8_t rowStart = row * MATRIX_COLS;
+  if (row == capture_row) {
+    const uint8_t *sample = column_readout(results, capture_col);
+    if (sample) {
+      capture_sample(sample[0] | (sample[1] << 8));
+    }
+  }
+  const bool monitor = TEST_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR);
+  uint32_t pressed = 0;
+  for (int8_t adc = NUM_ADCs - 1; adc >= 0; adc--) {
+    const int8_t firstCol = adc * ADC_CHANNELS;
+    int8_t curCol = firstCol + active_channels - 1;
+    if (curCol >= MATRIX_COLS) {
+      // Phantom channels come first - skip them.
+      readout += (curCol - MATRIX_COLS + 1) * 4;
+      curCol = MATRIX_COLS - 1;
+    }
+    if (monitor) {
       // When monitoring matrix we're interested in raw feed.
-      // We also want to see all the keys, even ignored ones.
-      scan_set_matrix_value(--keyIndex, Results[adc_buffer_pos]);
+      // We also want to see all the keys, even ignored ones - as long as
+      // they are scanned. Full readout - monitor stream carries all adcBits.
+      for (; curCol >= firstCol; curCol--, readout += 4) {
+        scan_set_matrix_value(rowStart + curCol, readout[0] | (readout[1] << 8));
+      }
       continue;
     }
-    const uint8_t threshold = config.thresholds[--keyIndex];
-    if (threshold == K_IGNORE_KEY) {
-      continue; // As if nothing happened!
-    }
+    // Pack the row into a bitmask without branching - debouncing only looks
+    // at keys that changed or are still bouncing. Ignored keys read as
+    // released. Whole readout is compared, so one over 255 acts as 255
+    // against the 8-bit threshold.
+    const uint8_t *threshold = &config.thresholds[rowStart + curCol];
+    for (; curCol >= firstCol; curCol--, readout += 4) {
+      const uint8_t t = *threshold--;
+      const uint16_t level = readout[0] | (readout[1] << 8);
 #if NORMALLY_LOW == 1
-    if (Results[adc_buffer_pos] > threshold) {
+      const uint32_t over = (level > t) & (t != K_IGNORE_KEY);
 #else
-    if (Results[adc_buffer_pos] < threshold) {
+      const uint32_t over = (level < t) & (t != K_IGNORE_KEY);
 #endif
-      append_debounced(0, keyIndex);
+      pressed |= over << curCol;
+    }
+  }
+  if (monitor) {
+    return;
+  }
 #if DEBUG_SHOW_MATRIX_EVENTS == 1
-      PIN_DEBUG(4, 1);
+  if (pressed) {
+    PIN_DEBUG(4, 1);
+  }
 #endif
-    } else {
-      append_debounced(KEY_UP_MASK, keyIndex);
-    }
+  if (pressed) {
+    governor_wake();
+  }
+  append_debounced_row(row, pressed);
+}
+
+CY_ISR(Result_ISR) {
+  const uint32_t isr_start = DWT_CYCCNT_REG;
+#ifdef DEBUG_INTERRUPTS
+  PIN_DEBUG(1, 2)
+#endif
+#if PROFILE_SCAN_PROCESSING == 1
+  CyPins_SetPin(ExpHdr_1);
+#endif
+#ifdef COMMONSENSE_100KHZ_MODE
+  // Full pass is in. DMA is already filling the other frame.
+  uint8_t (*frame)[RESULTS_ROW_BYTESIZE] =
+      &Results[reading_frame * active_row_count];
+  reading_frame ^= 1;
+  scan_passes++;
+  // End of the scan pass. Loop if full throttle, otherwise stop.
+  // Row being converted now will land into the other frame and that's it.
+  if (power_state != DEVSTATE_FULL_THROTTLE
+      || 0 == TEST_BIT(status_register, C2DEVSTATUS_SCAN_ENABLED)) {
+    CyDmaChDisable(RowDrive_DmaHandle);
+    scan_in_progress = false;
+  }
+  for (int8_t i = active_row_count - 1; i >= 0; i--) {
+    process_row(frame[i], active_row_list[i]);
+  }
+#else
+  if (!wake_pass) {
+    process_row(Results[0], reading_row);
+  } else if (reading_row < wake_group_count) {
+    wake_process_group(Results[0], reading_row);
   }
+#endif
 #if PROFILE_SCAN_PROCESSING == 1
   CyPins_ClearPin(ExpHdr_1);
 #endif
+  scan_count_cycles(TELEMETRY_ISR_RESULT, DWT_CYCCNT_REG - isr_start);
+}
+
+static inline bool scan_wants_full_layout(void) {
+  return TEST_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR)
+      || TEST_BIT(status_register, C2DEVSTATUS_SETUP_MODE)
+      || capture_row != CAPTURE_NO_ROW;
+}
+
+// Set things into "end of the cycle" position, then let magic happen.
+// Will cause a random first readout - but debouncing will take care of that.
+static void scan_kick(void) {
+#ifdef COMMONSENSE_100KHZ_MODE
+  // DMA rings may have been stopped anywhere - rewind them.
+  reading_frame = 0;
+  ResultBufferSetup();
+  RowDriveSetup();
+#endif
+  driving_row = active_row_list[0];
+  Drive(driving_row);
+  scan_in_progress = true;
+}
+
+// Layout can only change between passes - stop, set up, go on.
+static void scan_layout_tick(void) {
+  if (scan_wants_full_layout() == full_layout) {
+    return;
+  }
+  uint8_t enableInterrupts = CyEnterCriticalSection();
+  const bool enabled = TEST_BIT(status_register, C2DEVSTATUS_SCAN_ENABLED);
+  CLEAR_BIT(status_register, C2DEVSTATUS_SCAN_ENABLED);
+  CyExitCriticalSection(enableInterrupts);
+  while (scan_in_progress) {}
+  full_layout = !full_layout;
+  sensor_init();
+  if (enabled) {
+    enableInterrupts = CyEnterCriticalSection();
+    SET_BIT(status_register, C2DEVSTATUS_SCAN_ENABLED);
+    CyExitCriticalSection(enableInterrupts);
+    scan_kick();
+  }
 }
 
 void scan_init(uint8_t debouncing_period) {
   status_register &= (1 << C2DEVSTATUS_SETUP_MODE);
   while (scan_in_progress) {}; // Make sure scan is stopped.
   scan_common_init(debouncing_period);
+  full_layout = scan_wants_full_layout();
   sensor_init();
 }
 
@@ -264,12 +686,13 @@ void scan_start(void) {
   if (scan_in_progress) {
     return;
   }
+#ifndef COMMONSENSE_100KHZ_MODE
+  if (wake_scan_start()) {
+    return;
+  }
+#endif
   scan_common_start(SANITY_CHECK_DURATION);
-  // Set things into "end of the cycle" position, then let magic happen.
-  // Will cause a random first readout - but debouncing will take care of that.
-  driving_row = MATRIX_ROWS - 1;
-  Drive(driving_row);
-  scan_in_progress = true;
+  scan_kick();
 }
 
 void scan_nap(void) {
@@ -283,4 +706,9 @@ void scan_wake(void) {
 
 void scan_tick() {
   scan_common_tick();
+  governor_tick();
+  scan_layout_tick();
+  telemetry.scanSlowdown = governor_step;
+  telemetry.scanRows = active_row_count;
+  telemetry.scanColumns = active_col_count;
 };
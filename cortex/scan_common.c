@@ -14,24 +14,180 @@
 
 static uint32_t matrix_status[MATRIX_ROWS];
 bool matrix_was_active;
+/*
+ * Kept in step with matrix_status, so nobody has to sweep it:
+ * how many keys are down and which rows have any.
+ */
+static uint8_t keys_down;
+static uint32_t rows_down;
+// Key index to row and column - no div/mod in the debounce path.
+static uint8_t key_row[COMMONSENSE_MATRIX_SIZE];
+static uint8_t key_col[COMMONSENSE_MATRIX_SIZE];
 
 #define MAX_MATRIX_VALUE 0xffff
 uint16_t matrix[COMMONSENSE_MATRIX_SIZE];
-uint16_t debouncing_mask;
-uint16_t debouncing_posedge;
-uint16_t debouncing_negedge;
+// Debouncing constants by period, [0] is for keys using global debouncingTicks.
+// Indexed by config.debouncing - no per-sample math.
+static uint16_t debouncing_mask[MAX_DEBOUNCING_BUFFER_SIZE + 1];
+static uint16_t debouncing_posedge[MAX_DEBOUNCING_BUFFER_SIZE + 1];
+static uint16_t debouncing_negedge[MAX_DEBOUNCING_BUFFER_SIZE + 1];
 uint8_t scancodes_while_output_disabled = 0;
+static bool eager_press;
+
+#define ROW_COLUMNS_MASK ((uint32_t)((1ULL << MATRIX_COLS) - 1))
+
+/*
+ * Per-key chatter statistics, for tuning. All counters saturate.
+ * Bounce is a sample excursion the debouncer rejected - key went the other
+ * way and came back before the edge fired.
+ * Min press is the shortest press seen, in ms. KEY_STATS_NEVER - no presses.
+ */
+#define KEY_STATS_MAX 0xff
+#define KEY_STATS_NEVER 0xff
+static uint8_t key_bounces[COMMONSENSE_MATRIX_SIZE];
+static uint8_t key_min_press[COMMONSENSE_MATRIX_SIZE];
+static uint16_t key_press_start[COMMONSENSE_MATRIX_SIZE];
+
+// Matrix monitor stream state - last values host got, where next packet starts.
+#define MONITOR_MAX_QUEUED 1
+#define MONITOR_PAYLOAD_BITS ((sizeof(outbox.payload) - MONITOR_HEADER_SIZE) * 8)
+static uint16_t monitor_sent[COMMONSENSE_MATRIX_SIZE];
+static uint8_t monitor_pos;
+static uint8_t monitor_passes;
+
+/*
+ * Raw sample capture. Ring keeps CAPTURE_PRETRIGGER samples of history
+ * while waiting for the trigger, then records the rest and goes out to host.
+ */
+#define CAPTURE_SAMPLES 512
+// ^^^ THIS MUST EQUAL 2^n!!! Used as bitmask.
+#define CAPTURE_PRETRIGGER (CAPTURE_SAMPLES / 4)
+#define CAPTURE_PER_PACKET ((sizeof(outbox.payload) - CAPTURE_HEADER_SIZE) / 2)
+enum { CAPTURE_IDLE, CAPTURE_ARMED, CAPTURE_RECORDING, CAPTURE_SENDING };
+static volatile uint8_t capture_state = CAPTURE_IDLE;
+static uint16_t capture_buf[CAPTURE_SAMPLES];
+static uint16_t capture_pos;  // Next sample goes here - oldest when full.
+static uint16_t capture_left; // History still missing, or samples to go.
+static uint16_t capture_prev;
+static uint16_t capture_level;
+static uint8_t capture_trigger;
+static uint8_t capture_key;
+static uint16_t capture_sent;
+uint8_t capture_row = CAPTURE_NO_ROW;
+
+// Telemetry accumulators, moved into telemetry every second.
+static uint32_t isr_min[TELEMETRY_ISRS];
+static uint32_t isr_max[TELEMETRY_ISRS];
+static uint32_t isr_sum[TELEMETRY_ISRS];
+static uint32_t isr_count[TELEMETRY_ISRS];
+static uint16_t telemetry_ticks;
+static uint32_t telemetry_start;
+static void telemetry_restart(void);
+static void telemetry_tick(void);
+static void report_capture(void);
+
+static void monitor_restart(void) {
+  // 0xffff is never a readout - every key goes out as changed.
+  memset(monitor_sent, 0xff, sizeof(monitor_sent));
+  monitor_pos = 0;
+  monitor_passes = 0;
+}
+
+#ifdef VERTICAL_DEBOUNCING
+/*
+ * Vertical counters: bit N of every plane belongs to column N, so a logical
+ * op on a plane steps counters of the whole row at once.
+ * Counter is the length of the current run of identical samples minus one,
+ * saturating at 15. Shift register debouncer fires when the run is exactly
+ * debouncingTicks-1 samples long - so does this one.
+ */
+#define VC_PLANES 4
+static uint32_t vc_sample[MATRIX_ROWS];
+static uint32_t vc_count[VC_PLANES][MATRIX_ROWS];
+// Counter value that fires for every key, in planes. See scan_common_init.
+static uint32_t vc_fire[VC_PLANES][MATRIX_ROWS];
+// Keys with debouncingTicks of 1 - no debouncing, key follows the sample.
+static uint32_t vc_immediate[MATRIX_ROWS];
+#else
+// For append_debounced_row: last sampled state and keys mid-debounce.
+static uint32_t row_last_sample[MATRIX_ROWS];
+static uint32_t row_unsettled[MATRIX_ROWS];
+#endif
+
+static inline void count_bounce(uint8_t keyIndex) {
+  if (key_bounces[keyIndex] < KEY_STATS_MAX) {
+    ++key_bounces[keyIndex];
+  }
+}
+
+static inline void time_press(uint8_t flags, uint8_t keyIndex) {
+  const uint16_t now = systime;
+  if (!(flags & KEY_UP_MASK)) {
+    key_press_start[keyIndex] = now;
+    return;
+  }
+  const uint16_t held = now - key_press_start[keyIndex];
+  if (held < key_min_press[keyIndex]) {
+    key_min_press[keyIndex] = held;
+  }
+}
+
+static inline void mark_key_down(uint8_t keyIndex) {
+  const uint8_t row = key_row[keyIndex];
+  const uint32_t bit = 1UL << key_col[keyIndex];
+  if (matrix_status[row] & bit) {
+    return;
+  }
+  matrix_status[row] |= bit;
+  SET_BIT(rows_down, row);
+  ++keys_down;
+}
+
+static inline void mark_key_up(uint8_t keyIndex) {
+  const uint8_t row = key_row[keyIndex];
+  const uint32_t bit = 1UL << key_col[keyIndex];
+  if (!(matrix_status[row] & bit)) {
+    return;
+  }
+  matrix_status[row] &= ~bit;
+  if (!matrix_status[row]) {
+    CLEAR_BIT(rows_down, row);
+  }
+  --keys_down;
+}
+
+// Producer side of the scancode ring. False if the ring is full.
+static inline bool push_scancode(uint8_t flags, uint8_t scancode) {
+  const uint8_t wpos = scancodes_wpos;
+  const uint8_t next = SCANCODES_NEXT(wpos);
+  if (next == scancodes_rpos) {
+    if (scancodes_dropped < UINT16_MAX) {
+      ++scancodes_dropped;
+    }
+    return false;
+  }
+  scancodes[wpos].flags = flags;
+  scancodes[wpos].scancode = scancode;
+  scancodes[wpos].detected = DWT_CYCCNT_REG | 1;
+  MEMORY_BARRIER(); // Slot must be filled before reader can see it.
+  scancodes_wpos = next;
+  const uint8_t used = SCANCODES_USED();
+  if (used > scancodes_high_water) {
+    scancodes_high_water = used;
+  }
+  return true;
+}
 
 inline void append_scancode(uint8_t flags, uint8_t scancode) {
-  uint8_t row = scancode / MATRIX_COLS;
-  uint8_t col = scancode % MATRIX_COLS;
   if (0 == TEST_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED)) {
     if (scancodes_while_output_disabled <= SCANNER_INSANITY_THRESHOLD) {
       // Avoid overflowing counter! Things can get ugly FAST!
       ++scancodes_while_output_disabled;
 
       // Mark the key as noisy
-      SET_BIT(matrix_status[row], col);
+      if (scancode < COMMONSENSE_MATRIX_SIZE) {
+        mark_key_down(scancode);
+      }
     }
     return;
   }
@@ -43,36 +199,156 @@ inline void append_scancode(uint8_t flags, uint8_t scancode) {
     PIN_DEBUG(1, 2)
   }
 #endif
-  scancodes_wpos = SCANCODES_NEXT(scancodes_wpos);
-  scancodes[scancodes_wpos].flags = flags;
-  scancodes[scancodes_wpos].scancode = scancode;
+  if (scancode >= COMMONSENSE_MATRIX_SIZE) {
+    // NOKEY and friends. Not in the matrix - no status to keep.
+    push_scancode(flags, scancode);
+    return;
+  }
+  time_press(flags, scancode);
+  // Matrix status is kept even if the event is dropped - so "all keys up"
+  // still comes and unsticks whatever was lost.
+  push_scancode(flags, scancode);
   if (flags & KEY_UP_MASK) {
-    CLEAR_BIT(matrix_status[row], col);
+    mark_key_up(scancode);
   } else {
-    SET_BIT(matrix_status[row], col);
+    mark_key_down(scancode);
     matrix_was_active = true;
   }
 }
 
+#ifdef VERTICAL_DEBOUNCING
+// Only columns in cols are sampled, the rest are left alone.
+static inline void debounce_row(uint8_t row, uint32_t pressed, uint32_t cols) {
+  const uint32_t changed = (pressed ^ vc_sample[row]) & cols;
+  vc_sample[row] ^= changed;
+  // Saturating increment - saturated counters don't get a carry.
+  // Counters of changed keys are reset.
+  uint32_t carry = cols & ~(vc_count[0][row] & vc_count[1][row] &
+                            vc_count[2][row] & vc_count[3][row]);
+  // Eager press needs the run of released samples before this one to be
+  // long enough - counter >= fire value, compared from the top plane down.
+  uint32_t run_above = 0;
+  uint32_t run_equal = cols;
+  if (eager_press) {
+    for (int8_t i = VC_PLANES - 1; i >= 0; i--) {
+      run_above |= run_equal & vc_count[i][row] & ~vc_fire[i][row];
+      run_equal &= ~(vc_count[i][row] ^ vc_fire[i][row]);
+    }
+  }
+  uint32_t fire = cols;
+  for (uint8_t i = 0; i < VC_PLANES; i++) {
+    const uint32_t plane = vc_count[i][row];
+    vc_count[i][row] = (plane ^ carry) & ~changed;
+    fire &= ~(vc_count[i][row] ^ vc_fire[i][row]);
+    carry &= plane;
+  }
+  if (eager_press) {
+    // Releases are debounced as usual, presses go out right away.
+    fire = (fire & ~vc_sample[row]) |
+           (changed & vc_sample[row] & (run_above | run_equal));
+  }
+  fire |= cols & vc_immediate[row];
+  // Sample went back to the debounced state - excursion got rejected.
+  uint32_t bounces =
+      changed & ~vc_immediate[row] & ~(vc_sample[row] ^ matrix_status[row]);
+  while (bounces) {
+    const uint8_t col = __builtin_ctz(bounces);
+    bounces &= bounces - 1;
+    count_bounce(row * MATRIX_COLS + col);
+  }
+  // Press when key is up, release when it's down.
+  uint32_t events = fire & (vc_sample[row] ^ matrix_status[row]);
+  while (events) {
+    const uint8_t col = __builtin_ctz(events);
+    events &= events - 1;
+    append_scancode(TEST_BIT(pressed, col) ? 0 : KEY_UP_MASK,
+                    row * MATRIX_COLS + col);
+  }
+}
+
 inline void append_debounced(uint8_t flags, uint8_t keyIndex) {
+  const uint32_t col_bit = 1UL << key_col[keyIndex];
+  debounce_row(key_row[keyIndex], (flags & KEY_UP_MASK) ? 0 : col_bit,
+               col_bit);
+}
+
+void append_debounced_row(uint8_t row, uint32_t pressed) {
+  debounce_row(row, pressed, ROW_COLUMNS_MASK);
+}
+#else
+/*
+ * Low 2 bits of the shift register are last 2 samples. If the latest sample
+ * is back to the debounced state and the one before wasn't - that's a bounce.
+ * Needs key state before the edge fires. Period 1 has no history to look at.
+ */
+static inline void check_bounce(uint8_t keyIndex, uint16_t cell,
+                                uint8_t period, bool key_down) {
+  if (!(debouncing_mask[period] & 2) && (cell & 3) == (key_down ? 1 : 2)) {
+    count_bounce(keyIndex);
+  }
+}
+
+inline void append_debounced(uint8_t flags, uint8_t keyIndex) {
+  const uint8_t period = config.debouncing[keyIndex];
+  check_bounce(keyIndex,
+               (matrix[keyIndex] << 1) | !(flags & KEY_UP_MASK), period,
+               scan_is_key_down(keyIndex));
   if (flags & KEY_UP_MASK) {
     // Release
-    matrix[keyIndex] = ((matrix[keyIndex] << 1) | debouncing_mask);
+    matrix[keyIndex] = ((matrix[keyIndex] << 1) | debouncing_mask[period]);
   } else {
     // Press
-    matrix[keyIndex] = ((matrix[keyIndex] << 1) | debouncing_mask) + 1;
+    matrix[keyIndex] = ((matrix[keyIndex] << 1) | debouncing_mask[period]) + 1;
   }
   // Do not try to optimize for checking keyDown once. Short circuiting will
   // take care of that and will be faster - 1 cmp in most checks, no bit ops.
-  if (matrix[keyIndex] == debouncing_posedge &&
+  if (matrix[keyIndex] == debouncing_posedge[period] &&
       !scan_is_key_down(keyIndex)) {
     append_scancode(0, keyIndex);
-  } else if (matrix[keyIndex] == debouncing_negedge &&
+  } else if (matrix[keyIndex] == debouncing_negedge[period] &&
              scan_is_key_down(keyIndex)) {
     append_scancode(KEY_UP_MASK, keyIndex);
   }
 }
 
+/*
+ * Debounces the whole row at once, pressed has a bit per column.
+ * Only keys that changed since the last sample or are still mid-debounce get
+ * their shift registers touched - the rest would stay as they are anyway.
+ */
+void append_debounced_row(uint8_t row, uint32_t pressed) {
+  uint32_t todo = (pressed ^ row_last_sample[row]) | row_unsettled[row];
+  row_last_sample[row] = pressed;
+  const uint8_t rowStart = row * MATRIX_COLS;
+  while (todo) {
+    const uint8_t col = __builtin_ctz(todo);
+    todo &= todo - 1;
+    const uint8_t keyIndex = rowStart + col;
+    const bool key_down = TEST_BIT(matrix_status[row], col);
+    const uint8_t period = config.debouncing[keyIndex];
+    uint16_t cell = (matrix[keyIndex] << 1) | debouncing_mask[period];
+    if (TEST_BIT(pressed, col)) {
+      ++cell;
+    }
+    matrix[keyIndex] = cell;
+    check_bounce(keyIndex, cell, period, key_down);
+    if (cell == debouncing_posedge[period] && !key_down) {
+      append_scancode(0, keyIndex);
+    } else if (cell == debouncing_negedge[period] && key_down) {
+      append_scancode(KEY_UP_MASK, keyIndex);
+    }
+    // Settled: all pressed or all released, and next sample can't be an edge.
+    if ((cell == MAX_MATRIX_VALUE || cell == debouncing_mask[period]) &&
+        cell != debouncing_posedge[period] &&
+        cell != debouncing_negedge[period]) {
+      CLEAR_BIT(row_unsettled[row], col);
+    } else {
+      SET_BIT(row_unsettled[row], col);
+    }
+  }
+}
+#endif
+
 inline void scan_set_matrix_value(uint8_t keyIndex, uint16_t value) {
   matrix[keyIndex] = value;
 }
@@ -81,21 +357,21 @@ inline void scan_set_matrix_value(uint8_t keyIndex, uint16_t value) {
  * Generates that "matrix is idle" key
  */
 inline void scan_check_matrix(void) {
-  if (!matrix_was_active) {
+  if (!matrix_was_active || keys_down) {
     return;
   }
-  bool matrix_active_now = false;
-  for (uint8_t i=0; i<MATRIX_ROWS; i++) {
-    matrix_active_now |= (matrix_status[i] > 0);
-  }
-  if (!matrix_active_now) {
-    append_scancode(KEY_UP_MASK, COMMONSENSE_NOKEY);
+  // Scanner ISRs write the ring too - one producer at a time.
+  uint8_t enableInterrupts = CyEnterCriticalSection();
+  // Key could have gone down since the check above - look again.
+  // If the ring is full - try again next tick.
+  if (!keys_down && push_scancode(KEY_UP_MASK, COMMONSENSE_NOKEY)) {
     matrix_was_active = false;
   }
+  CyExitCriticalSection(enableInterrupts);
 }
 
 inline bool scan_is_key_down(uint8_t keyIndex) {
-  return BIT_IS_SET(matrix_status[keyIndex / MATRIX_COLS], keyIndex % MATRIX_COLS);
+  return matrix_status[key_row[keyIndex]] & (1UL << key_col[keyIndex]);
 }
 
 void scan_sanity_check() {
@@ -121,23 +397,89 @@ void scan_common_init(uint8_t debounce_period) {
    */
   status_register &= (1 << C2DEVSTATUS_SETUP_MODE);
 
+  for (uint8_t keyIndex = 0; keyIndex < COMMONSENSE_MATRIX_SIZE; keyIndex++) {
+    key_row[keyIndex] = keyIndex / MATRIX_COLS;
+    key_col[keyIndex] = keyIndex % MATRIX_COLS;
+  }
+
   // Init debouncing parameters.
   // Example: 8 bits total, 4 debouncing steps.
   // Negative/falling edge: xxxx 1000 - pressed, followed by 3 released.
   // Positive/raising edge: xxxx 0111 - released, followed by 3 pressed.
-  debouncing_mask = MAX_MATRIX_VALUE << debounce_period;
-  debouncing_negedge = MAX_MATRIX_VALUE << (debounce_period - 1);
-  debouncing_posedge = ~debouncing_negedge | debouncing_mask;
+  // Eager press: xxxx 0001 - first pressed sample after 3 released.
+  eager_press = (config.debouncingMode == DEBOUNCING_EAGER_PRESS);
+  for (uint8_t i = 0; i <= MAX_DEBOUNCING_BUFFER_SIZE; i++) {
+    const uint8_t period = i ? i : debounce_period;
+    debouncing_mask[i] = MAX_MATRIX_VALUE << period;
+    debouncing_negedge[i] = MAX_MATRIX_VALUE << (period - 1);
+    debouncing_posedge[i] = ~debouncing_negedge[i] | debouncing_mask[i];
+    if (period == 1) {
+      // Only the latest sample is in the window - no debouncing, fire when
+      // it differs from the key. Formulas above would invert keys.
+      debouncing_posedge[i] = MAX_MATRIX_VALUE;
+      debouncing_negedge[i] = debouncing_mask[i];
+    } else if (eager_press) {
+      debouncing_posedge[i] = debouncing_mask[i] | 1;
+    }
+  }
+#ifdef VERTICAL_DEBOUNCING
+  // Fire when the run reaches period-1 samples, counter is run-1.
+  memset(vc_fire, 0, sizeof(vc_fire));
+  memset(vc_immediate, 0, sizeof(vc_immediate));
+  uint8_t keyIndex = 0;
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++, keyIndex++) {
+      const uint8_t period = config.debouncing[keyIndex]
+                                 ? config.debouncing[keyIndex]
+                                 : debounce_period;
+      if (period < 2) {
+        SET_BIT(vc_immediate[row], col);
+        continue;
+      }
+      for (uint8_t i = 0; i < VC_PLANES; i++) {
+        if (((period - 2) >> i) & 1) {
+          SET_BIT(vc_fire[i][row], col);
+        }
+      }
+    }
+  }
+#endif
+  scan_clear_key_stats();
+  telemetry_restart();
+  memset(&telemetry, 0, sizeof(telemetry));
+  scancodes_dropped = 0;
+  scancodes_high_water = 0;
+}
+
+void scan_clear_key_stats(void) {
+  memset(key_bounces, 0, sizeof(key_bounces));
+  memset(key_min_press, KEY_STATS_NEVER, sizeof(key_min_press));
 }
 
 void scan_common_reset() {
-  for(uint8_t i = 0; i <= SCANCODES_END; i++) {
-    scancodes[i].flags = 0;
-    scancodes[i].scancode = COMMONSENSE_NOKEY;
-  }
   memset(matrix_status, 0, sizeof(matrix_status));
+  keys_down = 0;
+  rows_down = 0;
+#ifdef VERTICAL_DEBOUNCING
+  // Same history as matrix below: long run of released (or pressed) samples.
+  memset(vc_count, 0xff, sizeof(vc_count));
+  for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+#if NORMALLY_LOW == 1
+    vc_sample[i] = 0;
+#else
+    vc_sample[i] = ROW_COLUMNS_MASK;
+#endif
+  }
+#else
+  // Matrix is rewritten below - every key needs a look.
+  memset(row_last_sample, 0, sizeof(row_last_sample));
+  for (uint8_t i = 0; i < MATRIX_ROWS; i++) {
+    row_unsettled[i] = ROW_COLUMNS_MASK;
+  }
+#endif
   scancodes_rpos = 0;
   scancodes_wpos = 0;
+  monitor_restart();
   for (uint8_t i = 0; i < COMMONSENSE_MATRIX_SIZE; i++) {
 #if NORMALLY_LOW == 1
     matrix[i] = 0;
@@ -157,28 +499,253 @@ void scan_common_start(uint16_t sanity_check_duration) {
 
 void scan_common_tick() {
   scan_check_matrix();
+  report_capture();
+  telemetry_tick();
 }
 
 
+/*
+ * Matrix monitor stream, see C2RESPONSE_MATRIX_DELTA.
+ * Called every tick. Sends at most one packet and only if host has picked up
+ * everything but MONITOR_MAX_QUEUED packets - never waits for USB.
+ * Packet covers as many keys as fit, next one picks up where it stopped.
+ */
 void report_matrix_readouts(void) {
-  uint8_t idx = 0;
-  for (uint8 i = 0; i < MATRIX_ROWS; i++) {
-    outbox.response_type = C2RESPONSE_MATRIX_ROW;
-    outbox.payload[0] = i;
-    outbox.payload[1] = MATRIX_COLS;
-    for (uint8_t j = 0; j < MATRIX_COLS; j++) {
-      outbox.payload[2 + j] = matrix[idx++] & 0xff;
+  if (usb_queue_length() > MONITOR_MAX_QUEUED) {
+    return;
+  }
+  const uint8_t width = config.adcBits;
+  const uint16_t value_max = (1 << width) - 1;
+  memset(outbox.raw, 0, sizeof(outbox));
+  outbox.response_type = C2RESPONSE_MATRIX_DELTA;
+  outbox.payload[0] = width;
+  outbox.payload[1] = monitor_pos;
+  uint8_t *out = &outbox.payload[MONITOR_HEADER_SIZE];
+  uint32_t acc = 0;
+  uint8_t acc_bits = 0;
+  uint16_t used = 0;
+  uint8_t count = 0;
+  for (uint8_t i = monitor_pos; i < COMMONSENSE_MATRIX_SIZE; i++, count++) {
+    // Scanner ISR writes matrix - read once. Saturate, don't wrap.
+    const uint16_t level = matrix[i];
+    const uint16_t value = (level > value_max) ? value_max : level;
+    const bool changed = (value != monitor_sent[i]);
+    const uint8_t bits = changed ? width + 1 : 1;
+    if (used + bits > MONITOR_PAYLOAD_BITS) {
+      break;
+    }
+    used += bits;
+    if (changed) {
+      acc |= (((uint32_t)value << 1) | 1) << acc_bits;
+      monitor_sent[i] = value;
+    }
+    acc_bits += bits;
+    while (acc_bits >= 8) {
+      *out++ = acc;
+      acc >>= 8;
+      acc_bits -= 8;
+    }
+  }
+  if (acc_bits) {
+    *out = acc;
+  }
+  outbox.payload[2] = count;
+  monitor_pos += count;
+  if (monitor_pos >= COMMONSENSE_MATRIX_SIZE) {
+    monitor_pos = 0;
+    if (++monitor_passes == MONITOR_KEYFRAME_PASSES) {
+      monitor_restart();
+    }
+  }
+  usb_send_c2();
+}
+
+void scan_capture_arm(uint8_t keyIndex, uint8_t trigger, uint16_t level) {
+  uint8_t enableInterrupts = CyEnterCriticalSection();
+  capture_row = CAPTURE_NO_ROW;
+  capture_state = CAPTURE_IDLE;
+  if (keyIndex < COMMONSENSE_MATRIX_SIZE) {
+    capture_key = keyIndex;
+    capture_trigger = trigger;
+    capture_level = level;
+    capture_pos = 0;
+    capture_left = CAPTURE_PRETRIGGER;
+    capture_sent = 0;
+    capture_col = keyIndex % MATRIX_COLS;
+    capture_row = keyIndex / MATRIX_COLS;
+    capture_state = CAPTURE_ARMED;
+  }
+  CyExitCriticalSection(enableInterrupts);
+}
+
+// Called by scanner from ISR, once per scan pass.
+void capture_sample(uint16_t value) {
+  const uint16_t prev = capture_prev;
+  capture_prev = value;
+  capture_buf[capture_pos] = value;
+  capture_pos = (capture_pos + 1) & (CAPTURE_SAMPLES - 1);
+  if (capture_left > 0) {
+    if (--capture_left == 0 && capture_state == CAPTURE_RECORDING) {
+      capture_row = CAPTURE_NO_ROW;
+      capture_state = CAPTURE_SENDING;
+    }
+    return;
+  }
+  if (capture_state != CAPTURE_ARMED) {
+    return;
+  }
+  bool fire;
+  switch (capture_trigger) {
+  case CAPTURE_TRIGGER_RISING:
+    fire = (prev < capture_level && value >= capture_level);
+    break;
+  case CAPTURE_TRIGGER_FALLING:
+    fire = (prev > capture_level && value <= capture_level);
+    break;
+  default:
+    fire = true;
+  }
+  if (fire) {
+    // Trigger sample is in, CAPTURE_PRETRIGGER samples before it.
+    capture_left = CAPTURE_SAMPLES - CAPTURE_PRETRIGGER - 1;
+    capture_state = CAPTURE_RECORDING;
+  }
+}
+
+// Sends full capture buffer, oldest sample first. Same pacing as monitor.
+static void report_capture(void) {
+  if (capture_state != CAPTURE_SENDING ||
+      usb_queue_length() > MONITOR_MAX_QUEUED) {
+    return;
+  }
+  uint8_t count = CAPTURE_PER_PACKET;
+  if (capture_sent + count > CAPTURE_SAMPLES) {
+    count = CAPTURE_SAMPLES - capture_sent;
+  }
+  outbox.response_type = C2RESPONSE_CAPTURE;
+  outbox.payload[0] = capture_key;
+  outbox.payload[1] = count;
+  outbox.payload[2] = capture_sent & 0xff;
+  outbox.payload[3] = capture_sent >> 8;
+  outbox.payload[4] = CAPTURE_SAMPLES & 0xff;
+  outbox.payload[5] = CAPTURE_SAMPLES >> 8;
+  outbox.payload[6] = CAPTURE_PRETRIGGER & 0xff;
+  outbox.payload[7] = CAPTURE_PRETRIGGER >> 8;
+  uint8_t *out = &outbox.payload[CAPTURE_HEADER_SIZE];
+  for (uint8_t i = 0; i < count; i++) {
+    const uint16_t value =
+        capture_buf[(capture_pos + capture_sent + i) & (CAPTURE_SAMPLES - 1)];
+    *out++ = value & 0xff;
+    *out++ = value >> 8;
+  }
+  capture_sent += count;
+  if (capture_sent == CAPTURE_SAMPLES) {
+    capture_state = CAPTURE_IDLE;
+  }
+  usb_send_c2();
+}
+
+// Called by scanner ISRs - keep it short.
+void scan_count_cycles(uint8_t isr, uint32_t cycles) {
+  if (cycles < isr_min[isr]) {
+    isr_min[isr] = cycles;
+  }
+  if (cycles > isr_max[isr]) {
+    isr_max[isr] = cycles;
+  }
+  isr_sum[isr] += cycles;
+  isr_count[isr]++;
+}
+
+static void telemetry_restart(void) {
+  uint8_t enableInterrupts = CyEnterCriticalSection();
+  for (uint8_t i = 0; i < TELEMETRY_ISRS; i++) {
+    isr_min[i] = UINT32_MAX;
+    isr_max[i] = 0;
+    isr_sum[i] = 0;
+    isr_count[i] = 0;
+  }
+  scan_passes = 0;
+  idle_cycles = 0;
+  telemetry_ticks = 0;
+  telemetry_start = DWT_CYCCNT_REG;
+  CyExitCriticalSection(enableInterrupts);
+}
+
+// Every second - move accumulated numbers into telemetry, start over.
+static void telemetry_tick(void) {
+  if (++telemetry_ticks < 1000) {
+    return;
+  }
+  const uint32_t elapsed = DWT_CYCCNT_REG - telemetry_start;
+  uint8_t enableInterrupts = CyEnterCriticalSection();
+  telemetry.passesPerSecond = scan_passes;
+  for (uint8_t i = 0; i < TELEMETRY_ISRS; i++) {
+    telemetry.isrCycles[i][TELEMETRY_MIN] = isr_count[i] ? isr_min[i] : 0;
+    telemetry.isrCycles[i][TELEMETRY_AVG] =
+        isr_count[i] ? isr_sum[i] / isr_count[i] : 0;
+    telemetry.isrCycles[i][TELEMETRY_MAX] = isr_max[i];
+  }
+  const uint32_t idle = idle_cycles;
+  CyExitCriticalSection(enableInterrupts);
+  telemetry.cpuHz = BCLK__BUS_CLK__HZ;
+  uint32_t idle_permille = idle / (elapsed / 1000 + 1);
+  if (idle_permille > 1000) {
+    idle_permille = 1000;
+  }
+  telemetry.mainLoopLoad = 1000 - idle_permille;
+  telemetry_restart();
+}
+
+void report_telemetry(void) {
+  memset(outbox.raw, 0, sizeof(outbox));
+  outbox.response_type = C2RESPONSE_TELEMETRY;
+  memcpy(outbox.payload, &telemetry, sizeof(telemetry));
+  usb_send_c2();
+}
+
+/*
+ * Sends per-key stats in C2RESPONSE_KEY_STATS packets.
+ * Payload: first key, key count, matrix size, then count bounce counters
+ * followed by count min press durations.
+ */
+#define KEY_STATS_PER_PACKET ((sizeof(outbox.payload) - 3) / 2)
+void report_key_stats(bool clear) {
+  for (uint16_t start = 0; start < COMMONSENSE_MATRIX_SIZE;
+       start += KEY_STATS_PER_PACKET) {
+    uint8_t count = KEY_STATS_PER_PACKET;
+    if (start + count > COMMONSENSE_MATRIX_SIZE) {
+      count = COMMONSENSE_MATRIX_SIZE - start;
     }
+    outbox.response_type = C2RESPONSE_KEY_STATS;
+    outbox.payload[0] = start;
+    outbox.payload[1] = count;
+    outbox.payload[2] = COMMONSENSE_MATRIX_SIZE;
+    memcpy(&outbox.payload[3], &key_bounces[start], count);
+    memcpy(&outbox.payload[3 + count], &key_min_press[start], count);
     usb_send_c2_blocking();
   }
+  if (clear) {
+    scan_clear_key_stats();
+  }
 }
 
+/*
+ * One row per call, going down. Only rows with noisy keys are worth sending -
+ * insane matrix never gets keys cleared, so host has nothing to unlearn.
+ */
 void scan_report_insanity() {
   static uint8_t cur_row = 0;
   if (cur_row == 0) {
     cur_row = MATRIX_ROWS;
   }
   --cur_row;
+  const uint32_t below = rows_down & ((2UL << cur_row) - 1);
+  if (below) {
+    cur_row = 31 - __builtin_clz(below);
+  } else if (rows_down) {
+    cur_row = 31 - __builtin_clz(rows_down);
+  }
   outbox.response_type = C2RESPONSE_MATRIX_ROW;
   outbox.payload[0] = cur_row;
   outbox.payload[1] = MATRIX_COLS;
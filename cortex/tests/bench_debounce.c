@@ -0,0 +1,98 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Row debouncing cost on the host: append_debounced_row against running
+ * append_debounced for every column, as Result_ISR used to. Host numbers
+ * only compare the two - Result_ISR cycles on the device are in telemetry.
+ * Both must send the same events, or the numbers mean nothing.
+ */
+#include <time.h>
+
+#include "../scan_common.c"
+#include "test.h"
+
+#define PASSES 200000
+
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+// Pressed columns of a row, pass by pass.
+typedef uint32_t (*sampler_t)(uint8_t row, uint32_t pass);
+
+// Nothing pressed, nothing moving - the common case.
+static uint32_t settled(uint8_t row, uint32_t pass) { return 0; }
+
+// One key typed at a time, chattering for a few samples around each edge.
+static uint32_t typing(uint8_t row, uint32_t pass) {
+  const uint32_t key = (pass / 64) % (MATRIX_ROWS * MATRIX_COLS);
+  if (key / MATRIX_COLS != row) {
+    return 0;
+  }
+  const uint32_t phase = pass % 64;
+  const bool down = phase >= 8 && phase < 40;
+  const bool chatter = (phase >= 8 && phase < 12) || (phase >= 40 && phase < 44);
+  return ((chatter ? rng() & 1 : down) ? 1UL : 0) << (key % MATRIX_COLS);
+}
+
+// Every key bouncing all the time - worst case.
+static uint32_t noisy(uint8_t row, uint32_t pass) {
+  return rng() & ((1UL << MATRIX_COLS) - 1);
+}
+
+static void per_column(uint8_t row, uint32_t pressed) {
+  uint8_t keyIndex = row * MATRIX_COLS;
+  for (uint8_t col = 0; col < MATRIX_COLS; col++, keyIndex++) {
+    append_debounced(((pressed >> col) & 1) ? 0 : KEY_UP_MASK, keyIndex);
+  }
+}
+
+static double run(void (*debounce)(uint8_t, uint32_t), sampler_t sample,
+                  unsigned *events) {
+  scan_common_init(4);
+  scan_common_reset();
+  SET_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED);
+  rng_state = 0x9e3779b9u;
+  *events = 0;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint32_t pass = 0; pass < PASSES; pass++) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      debounce(row, sample(row, pass));
+      // Ring is shorter than a noisy pass.
+      *events += SCANCODES_USED();
+      scancodes_rpos = scancodes_wpos;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+                    (end.tv_nsec - start.tv_nsec);
+  return ns / PASSES / MATRIX_ROWS;
+}
+
+static void bench(const char *name, sampler_t sample) {
+  unsigned before_events, after_events;
+  const double before = run(per_column, sample, &before_events);
+  const double after = run(append_debounced_row, sample, &after_events);
+  printf("%-8s per column %6.1f ns/row, append_debounced_row %6.1f ns/row, "
+         "%u events\n",
+         name, before, after, after_events);
+  CHECK(before_events == after_events, "%s: %u events per column", name,
+        before_events);
+}
+
+int main(void) {
+  bench("settled", settled);
+  bench("typing", typing);
+  bench("noisy", noisy);
+  return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Pipeline on the host. Scancodes go into the ring through append_scancode,
+ * ticks() runs main loop passes. Whatever reaches the reports is logged and
+ * compared as text, one "time:event" per HID event:
+ *   +a / -a  - key press / release, a-z, others as hex;
+ *   M0..M2   - mods stack operation, see macroModsOp, M0=xx - push of xx;
+ *   |        - report boundary.
+ */
+#pragma once
+#include "../scan_common.c"
+#include "../pipeline.c"
+#include "test.h"
+
+// Key n of the matrix types keycode KC(n) on layer 0.
+#define KC(N) (USBCODE_A + (N))
+#define KC_LEFT_SHIFT USBCODE_LEFT_SHIFT
+
+// Macro commands, see run_macro. D is delayLib index.
+#define TYPE(D, KC) (D) << 2, KC
+#define PRESS(D, KC) 0x40 | (D) << 2, KC
+#define RELEASE(D, KC) 0x40 | (D) << 2 | MACRO_KEY_UPDOWN_RELEASE, KC
+#define PUSH_MODS(D, MODS) 0x80 | (D) << 2 | MACRO_MODS_PUSH, MODS
+#define POP_MODS(D) 0x80 | (D) << 2 | MACRO_MODS_POP
+#define WAIT(D) 0xc0 | (D) << 2
+#define STRING(D, N) 0xc0 | (D) << 2 | MACRO_WAIT_TYPE_STRING, N
+// delayLib index D is D * 10ms - but DELAYS_EVENT is 0 and DELAYS_TAP is
+// TAP_MS, macros use 2 and up.
+#define DELAY_MS(D) ((D) * 10)
+#define TAP_MS 200
+
+static char sent[4096];
+static size_t sent_length;
+static bool report_open;
+// detected of every logged event, in order.
+static uint32_t sent_detected[256];
+static uint16_t sent_count;
+
+static void log_text(const char *text) {
+  sent_length += snprintf(sent + sent_length, sizeof(sent) - sent_length,
+                          "%s%s", sent_length ? " " : "", text);
+}
+
+static void log_event(const queuedScancode *key) {
+  char text[16];
+  const uint8_t op = key->flags & USBQUEUE_MODS_OP;
+  if ((key->flags & USBQUEUE_MODS_MASK) && op == MACRO_MODS_PUSH) {
+    snprintf(text, sizeof(text), "%d:M%d=%02x", systime, op, key->mods);
+  } else if (key->flags & USBQUEUE_MODS_MASK) {
+    snprintf(text, sizeof(text), "%d:M%d", systime, op);
+  } else {
+    const char sign = (key->flags & USBQUEUE_RELEASED_MASK) ? '-' : '+';
+    if (key->keycode >= KC(0) && key->keycode <= KC(25)) {
+      snprintf(text, sizeof(text), "%d:%c%c", systime, sign,
+               'a' + key->keycode - KC(0));
+    } else {
+      snprintf(text, sizeof(text), "%d:%c%02x", systime, sign, key->keycode);
+    }
+  }
+  log_text(text);
+  report_open = true;
+  if (sent_count < sizeof(sent_detected) / sizeof(sent_detected[0])) {
+    sent_detected[sent_count++] = key->detected;
+  }
+}
+
+void update_keyboard_report(queuedScancode *key) { log_event(key); }
+void update_keyboard_mods(queuedScancode *key) { log_event(key); }
+void update_consumer_report(queuedScancode *key) { log_event(key); }
+void update_system_report(queuedScancode *key) { log_event(key); }
+
+void usb_flush_reports(void) {
+  if (report_open) {
+    log_text("|");
+    report_open = false;
+  }
+}
+
+static uint16_t macros_end;
+
+// Config is set up by the test between these two.
+static void pipeline_setup(void) {
+  memset(&config, 0, sizeof(config));
+  macros_end = 0;
+  memset(config.macros, EMPTY_FLASH_BYTE, sizeof(config.macros));
+  for (uint8_t i = 0; i < NUM_DELAYS; i++) {
+    config.delayLib[i] = DELAY_MS(i);
+  }
+  config.delayLib[DELAYS_EVENT] = 0;
+  config.delayLib[DELAYS_TAP] = TAP_MS;
+  for (uint8_t i = 0; i < COMMONSENSE_MATRIX_SIZE; i++) {
+    config.layers[0][i] = KC(i % 26);
+  }
+}
+
+static void add_macro(uint8_t keycode, uint8_t flags, uint8_t length,
+                      const uint8_t *data) {
+  config.macros[macros_end] = keycode;
+  config.macros[macros_end + 1] = flags;
+  config.macros[macros_end + 2] = length;
+  memcpy(&config.macros[macros_end + 3], data, length);
+  macros_end += length + 3;
+}
+
+#define ADD_MACRO(KEYCODE, FLAGS, ...)                                         \
+  add_macro(KEYCODE, FLAGS, sizeof((uint8_t[]){__VA_ARGS__}),                  \
+            (uint8_t[]){__VA_ARGS__})
+
+static void pipeline_start(void) {
+  systime = 0;
+  scan_common_init(1);
+  scan_common_reset();
+  pipeline_init();
+  // Scanner init wipes the status.
+  status_register = 0;
+  SET_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED);
+  output_direction = OUTPUT_DIRECTION_USB;
+  sent_length = 0;
+  sent[0] = '\0';
+  sent_count = 0;
+  report_open = false;
+}
+
+// Scanner side. Every event gets its own detection stamp.
+static void press(uint8_t key) {
+  host_cycles += 2;
+  append_scancode(0, key);
+}
+
+static void release(uint8_t key) {
+  host_cycles += 2;
+  append_scancode(KEY_UP_MASK, key);
+}
+
+// Main loop passes, 1ms each.
+static void ticks(uint32_t count) {
+  while (count--) {
+    pipeline_process();
+    systime++;
+  }
+}
+
+static void run_until(uint32_t time) {
+  if (time > systime) {
+    ticks(time - systime);
+  }
+}
+
+#define EXPECT_SENT(EXPECTED)                                                  \
+  do {                                                                         \
+    CHECK(strcmp(sent, EXPECTED) == 0, "\n  got      %s\n  expected %s",       \
+          sent, EXPECTED);                                                     \
+    sent_length = 0;                                                           \
+    sent[0] = '\0';                                                            \
+    sent_count = 0;                                                            \
+  } while (0)
@@ -0,0 +1,29 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+// Host test config. Makefile overrides matrix size and ADC count with -D.
+#pragma once
+#include <stdint.h>
+
+#ifndef MATRIX_COLS
+#define MATRIX_COLS 16
+#endif
+#ifndef MATRIX_ROWS
+#define MATRIX_ROWS 8
+#endif
+#define MATRIX_LAYERS 4
+
+#ifndef SWITCH_TYPE
+#define SWITCH_TYPE BUCKLING_SPRING
+#endif
+
+#define BUS_POWERED
+#define USB_POWER_MODE USB_5V_OPERATION
+
+// No DWT on the host - tests step the cycle counter themselves.
+uint32_t host_cycles;
+#define DWT_CYCCNT_REG host_cycles
+#define MEMORY_BARRIER() __asm volatile("" ::: "memory")
@@ -0,0 +1,28 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+// Modules a test doesn't build in. Weak - a test that includes the real
+// module gets the real thing.
+#include "../../PSoC_USB.h"
+#include "../../exp.h"
+#include "../../sup_serial.h"
+
+#define WEAK __attribute__((weak))
+
+WEAK void xprintf(const char *format_p, ...) {}
+WEAK void pipeline_init(void) {}
+WEAK uint8_t usb_queue_length(void) { return 0; }
+WEAK void usb_send_c2(void) {}
+WEAK void usb_send_c2_blocking(void) {}
+WEAK void scan_reset(void) {}
+WEAK void reset_reports(void) {}
+WEAK void update_keyboard_report(queuedScancode *key) {}
+WEAK void update_consumer_report(queuedScancode *key) {}
+WEAK void update_system_report(queuedScancode *key) {}
+WEAK void exp_toggle(void) {}
+WEAK void exp_keypress(uint8_t keycode) {}
+WEAK void update_serial_keyboard_report(queuedScancode *key) {}
+WEAK void serial_reset_reports(void) {}
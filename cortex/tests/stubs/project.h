@@ -0,0 +1,159 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Stand-in for the PSoC Creator generated project.h, so cortex sources build
+ * on the host. Hardware calls do nothing and read back as zero. DMA is not
+ * simulated - tests fill the buffers DMA would have filled.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef volatile uint8_t reg8;
+typedef volatile uint32_t reg32;
+
+#define CY_ISR(N) void N(void)
+#define CY_ISR_PROTO(N) void N(void)
+
+#define HI16(X) ((uint16)((uint32)(X) >> 16))
+#define LO16(X) ((uint16)(X))
+#define LO8(X) ((uint8)(X))
+#define HI8(X) ((uint8)((X) >> 8))
+
+static inline uint8 CyEnterCriticalSection(void) { return 0; }
+static inline void CyExitCriticalSection(uint8 state) {}
+static inline void CyDelayUs(uint16 us) {}
+static inline void CyDelay(uint32 ms) {}
+static inline void CySoftwareReset(void) {}
+
+// Pins
+enum { ExpHdr_0, ExpHdr_1, ExpHdr_2, ExpHdr_3, ExpHdr_4, HPWR_0, SensePin_0 };
+static inline void CyPins_SetPin(int pin) {}
+static inline void CyPins_ClearPin(int pin) {}
+static inline int CyPins_ReadPin(int pin) { return 0; }
+
+// DMA
+#define CY_DMA_INVALID_TD 0xff
+#define CY_DMA_DISABLE_TD 0xfe
+#define CY_DMA_END_CHAIN_TD 0xff
+#define CY_DMA_CPU_REQ 1
+#define CY_DMA_TD_INC_SRC_ADR 0x01
+#define CY_DMA_TD_INC_DST_ADR 0x02
+#define CY_DMA_TD_AUTO_EXEC_NEXT 0x20
+#define TD_INC_DST_ADR 0x02
+#define CYDEV_PERIPH_BASE 0x40000000u
+#define CYDEV_SRAM_BASE 0x1fff8000u
+
+/*
+ * TDs and initial TDs are recorded, so a test can walk the chain and move
+ * the bytes itself. Addresses are low 16 bits, as on the chip.
+ */
+#define STUB_TDS 64
+#define STUB_CHANNELS 8
+typedef struct {
+  uint16 length;
+  uint8 next;
+  uint8 config;
+  uint16 src;
+  uint16 dst;
+} stub_td_t;
+stub_td_t stub_td[STUB_TDS];
+uint8 stub_tds_allocated;
+uint8 stub_initial_td[STUB_CHANNELS];
+
+static inline uint8 CyDmaClearPendingDrq(uint8 ch) { return 0; }
+static inline uint8 CyDmaTdAllocate(void) { return stub_tds_allocated++; }
+static inline void CyDmaTdFree(uint8 td) {}
+static inline uint8 CyDmaTdSetConfiguration(uint8 td, uint16 len, uint8 next,
+                                            uint8 cfg) {
+  stub_td[td].length = len;
+  stub_td[td].next = next;
+  stub_td[td].config = cfg;
+  return 0;
+}
+static inline uint8 CyDmaTdSetAddress(uint8 td, uint16 src, uint16 dst) {
+  stub_td[td].src = src;
+  stub_td[td].dst = dst;
+  return 0;
+}
+static inline uint8 CyDmaChSetInitialTd(uint8 ch, uint8 td) {
+  stub_initial_td[ch] = td;
+  return 0;
+}
+static inline uint8 CyDmaChEnable(uint8 ch, uint8 preserve) { return 0; }
+static inline uint8 CyDmaChDisable(uint8 ch) { return 0; }
+static inline uint8 CyDmaChSetRequest(uint8 ch, uint8 req) { return 0; }
+static inline uint8 CyDmaChRoundRobin(uint8 ch, uint8 enable) { return 0; }
+
+#define STUB_DMA(N, HANDLE)                                                    \
+  static inline uint8 N##_DmaInitialize(uint8 w, uint8 r, uint16 s,            \
+                                        uint16 d) {                            \
+    return HANDLE;                                                             \
+  }                                                                            \
+  enum { N##__TD_TERMOUT_EN = 0x04, N##_DmaHandle = HANDLE };
+STUB_DMA(Buf0, 0)
+STUB_DMA(Buf1, 1)
+STUB_DMA(FinalBuf, 2)
+
+// Registers nobody reads back - all land in one scratch word.
+uint32 stub_register;
+#define PTK_ChannelCounter__PERIOD_REG ((uintptr_t)&stub_register)
+#define PTK_ChannelCounter__CONTROL_AUX_CTL_REG ((uintptr_t)&stub_register)
+#define PTK_CtrlReg__CONTROL_REG ((uintptr_t)&stub_register)
+#define ADC0_ADC_SAR__WRK0 ((uintptr_t)&stub_register)
+#define ADC1_ADC_SAR__WRK0 ((uintptr_t)&stub_register)
+
+#define BCLK__BUS_CLK__HZ 36000000U
+
+// USB endpoint buffers, sizes as in TopDesign.
+typedef struct {
+  uint8 status;
+} T_USB_XFER_STATUS_BLOCK;
+T_USB_XFER_STATUS_BLOCK
+    USB_DEVICE0_CONFIGURATION0_INTERFACE0_ALTERNATE0_HID_OUT_RPT_SCB,
+    USB_DEVICE0_CONFIGURATION0_INTERFACE1_ALTERNATE0_HID_OUT_RPT_SCB;
+uint8 USB_DEVICE0_CONFIGURATION0_INTERFACE0_ALTERNATE0_HID_OUT_BUF[64];
+uint8 USB_DEVICE0_CONFIGURATION0_INTERFACE0_ALTERNATE0_HID_IN_BUF[64];
+uint8 USB_DEVICE0_CONFIGURATION0_INTERFACE1_ALTERNATE0_HID_OUT_BUF[64];
+uint8 USB_DEVICE0_CONFIGURATION0_INTERFACE2_ALTERNATE0_HID_IN_BUF[17];
+uint8 USB_DEVICE0_CONFIGURATION0_INTERFACE3_ALTERNATE0_HID_IN_BUF[2];
+
+// Components. Only what the cortex sources under test call.
+#define STUB_COMPONENT(N)                                                      \
+  static inline void N##_Start(void) {}                                        \
+  static inline void N##_Stop(void) {}                                         \
+  static inline void N##_Sleep(void) {}                                        \
+  static inline void N##_Wakeup(void) {}                                       \
+  static inline void N##_Enable(void) {}                                       \
+  static inline void N##_Disable(void) {}                                      \
+  static inline void N##_StartEx(void (*isr)(void)) {}                         \
+  static inline void N##_ClearPending(void) {}                                 \
+  static inline void N##_SetPending(void) {}                                   \
+  static inline void N##_SetResolution(uint8 bits) {}                          \
+  static inline void N##_Write(uint8 value) {}                                 \
+  static inline uint8 N##_Read(void) { return 0; }                             \
+  static inline void N##_WritePeriod(uint32 period) {}                         \
+  static inline void N##_SetValue(uint8 value) {}
+STUB_COMPONENT(ADC0)
+STUB_COMPONENT(ADC1)
+STUB_COMPONENT(ChargeDelay)
+STUB_COMPONENT(DischargeDelay)
+STUB_COMPONENT(DriveReg0)
+STUB_COMPONENT(DriveReg1)
+STUB_COMPONENT(DriveReg2)
+STUB_COMPONENT(ResultIRQ)
+STUB_COMPONENT(EoCIRQ)
+STUB_COMPONENT(Cmp0)
+STUB_COMPONENT(Cmp1)
+STUB_COMPONENT(VDAC0)
+STUB_COMPONENT(VDAC1)
+STUB_COMPONENT(SetupDelay)
+STUB_COMPONENT(ResetDelay)
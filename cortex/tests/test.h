@@ -0,0 +1,26 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+// Host tests. Each test is one translation unit that includes the cortex
+// sources it exercises - see Makefile.
+#pragma once
+#include <stdio.h>
+
+static unsigned test_failures;
+
+#define CHECK(COND, ...)                                                       \
+  do {                                                                         \
+    if (!(COND)) {                                                             \
+      printf("%s:%d: %s: ", __FILE__, __LINE__, #COND);                        \
+      printf(__VA_ARGS__);                                                     \
+      putchar('\n');                                                           \
+      ++test_failures;                                                         \
+    }                                                                          \
+  } while (0)
+
+// Exit code for main.
+#define TEST_RESULT()                                                          \
+  (test_failures ? (printf("%u checks failed\n", test_failures), 1) : 0)
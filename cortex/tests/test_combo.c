@@ -0,0 +1,127 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Combos on scripted scancode timelines. 'a'+'b' sends 'z', 'a'+'b'+'c'
+ * sends 'y', 'd' is in no combo. 'e' is a tap key typing 'x'.
+ */
+#include "pipeline_harness.h"
+
+#define A 0
+#define B 1
+#define C 2
+#define D 3
+#define E 4
+#define WINDOW_MS 30
+
+static void setup(void) {
+  pipeline_setup();
+  config.comboWindow = WINDOW_MS;
+  ADD_MACRO(KC(25), MACRO_TYPE_COMBO, KC(A), KC(B));
+  ADD_MACRO(KC(24), MACRO_TYPE_COMBO, KC(A), KC(B), KC(C));
+  ADD_MACRO(KC(E), MACRO_TYPE_TAP, TYPE(2, KC(23)));
+  pipeline_start();
+}
+
+// 'c' completes the bigger combo, it fires at once. First member release
+// releases it, the rest are eaten.
+static void fires(void) {
+  setup();
+  press(A);
+  ticks(5);
+  press(B);
+  ticks(5);
+  press(C);
+  run_until(20);
+  EXPECT_SENT("10:+y |");
+  release(B);
+  ticks(5);
+  release(A);
+  release(C);
+  run_until(50);
+  EXPECT_SENT("20:-y |");
+}
+
+// 'a'+'b' could still grow - fires when the window passes.
+static void window(void) {
+  setup();
+  press(A);
+  ticks(5);
+  press(B);
+  run_until(100);
+  EXPECT_SENT("30:+z |");
+}
+
+// Lone member goes out as itself when the window passes.
+static void alone(void) {
+  setup();
+  press(A);
+  run_until(100);
+  EXPECT_SENT("30:+a |");
+  release(A);
+  ticks(1);
+  EXPECT_SENT("100:-a |");
+}
+
+// Other key going up lets the pending ones out ahead of it. Key in no combo
+// gets no added latency.
+static void other_key(void) {
+  setup();
+  press(D);
+  ticks(1);
+  EXPECT_SENT("0:+d |");
+  press(A);
+  ticks(2);
+  press(C);
+  ticks(1);
+  EXPECT_SENT("");
+  release(D);
+  ticks(1);
+  EXPECT_SENT("4:+a 4:+c 4:-d |");
+}
+
+// Pending tap key with a nearly full tap_buffer - let out members must not
+// overfill it. Full buffer resolves the tap key as a hold.
+static void tap_buffer_full(void) {
+  setup();
+  press(E);
+  for (uint8_t i = 0; i < 14; i++) {
+    ticks(1);
+    press(5 + i);
+  }
+  ticks(1);
+  press(A);
+  ticks(1);
+  press(C);
+  ticks(1);
+  EXPECT_SENT("");
+  press(D);
+  run_until(50);
+  EXPECT_SENT("17:+e 17:+f 17:+g 17:+h 17:+i 17:+j 17:+k 17:+l 17:+m 17:+n "
+              "17:+o 17:+p 17:+q 17:+r 17:+s 17:+a 17:+c 17:+d |");
+}
+
+// Window off - members are plain keys.
+static void disabled(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(25), MACRO_TYPE_COMBO, KC(A), KC(B));
+  pipeline_start();
+  press(A);
+  ticks(1);
+  press(B);
+  ticks(1);
+  EXPECT_SENT("0:+a | 1:+b |");
+}
+
+int main(void) {
+  fires();
+  window();
+  alone();
+  other_key();
+  tap_buffer_full();
+  disabled();
+  return TEST_RESULT();
+}
@@ -0,0 +1,198 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Debouncer traces. Built with shift registers and with VERTICAL_DEBOUNCING,
+ * Makefile compares the two logs - they must match edge for edge.
+ * Hand-written traces of real bounce patterns have their events spelled out,
+ * so both builds are checked against them too. Long traces are noisy presses
+ * and releases from a seeded generator, so every run sees the same ones.
+ */
+#include "../scan_common.c"
+#include "test.h"
+
+#define SAMPLES 4000
+// Output is off for a while, as during the sanity check.
+#define OUTPUT_OFF_FROM 1500
+#define OUTPUT_OFF_TO 1700
+
+/*
+ * One key, sample by sample: '#' - pressed, '.' - released. Events are
+ * "d<sample>" for press and "u<sample>" for release, sample counts from 0.
+ * Key fires when the run of identical samples reaches period-1. Traces start
+ * released - normally high matrix starts with a pressed history.
+ */
+typedef struct {
+  const char *name;
+  uint8_t period;
+  uint8_t mode;
+  const char *samples;
+  const char *events;
+} hand_trace_t;
+
+static const hand_trace_t hand_traces[] = {
+    {"clean", 4, DEBOUNCING_SYMMETRIC, "....########......", "d6 u14"},
+    // Contacts chatter for a few samples before they close and open.
+    {"press chatter", 4, DEBOUNCING_SYMMETRIC, "..#.#..##.#######......", "d12 u19"},
+    {"release chatter", 4, DEBOUNCING_SYMMETRIC, ".#######.#.##..#.#.....", "d3 u20"},
+    // Glitch shorter than the period is not a key.
+    {"spike", 4, DEBOUNCING_SYMMETRIC, "....##.........", ""},
+    // Dropout while held is not a release.
+    {"dropout", 4, DEBOUNCING_SYMMETRIC, "..######..#######.....", "d4 u19"},
+    // Capsense readout hovering around the threshold on a slow press.
+    {"threshold", 6, DEBOUNCING_SYMMETRIC, "...#..#.#.##.###.#########......", "d21 u30"},
+    // Period 1 is no debouncing: every change of the sample goes out.
+    {"no debouncing", 1, DEBOUNCING_SYMMETRIC, "..#.##..#...", "d2 u3 d4 u6 d8 u9"},
+    {"no debouncing spike", 1, DEBOUNCING_SYMMETRIC, ".#.", "d1 u2"},
+    // Eager press: first pressed sample after period-1 released ones goes
+    // out, chatter after it is ignored. Release is debounced as usual.
+    {"eager press", 4, DEBOUNCING_EAGER_PRESS, "....#.#.###.....", "d4 u13"},
+    {"eager press, dropout", 4, DEBOUNCING_EAGER_PRESS,
+     "....####..#...", "d4 u13"},
+    // Period 1 has nothing to be eager about.
+    {"eager press, period 1", 1, DEBOUNCING_EAGER_PRESS, "..#.", "d2 u3"},
+};
+
+// Key 0 goes through append_debounced, the one below it through the row.
+#define HAND_KEY 0
+#define HAND_ROW_KEY MATRIX_COLS
+
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+// Per key: where it's going and how many noisy samples are left.
+static bool key_target[COMMONSENSE_MATRIX_SIZE];
+static uint8_t key_noise[COMMONSENSE_MATRIX_SIZE];
+
+static bool sample_key(uint8_t keyIndex) {
+  if (key_noise[keyIndex] == 0 && rng() % 64 == 0) {
+    key_target[keyIndex] = !key_target[keyIndex];
+    key_noise[keyIndex] = rng() % 12;
+  }
+  if (key_noise[keyIndex]) {
+    --key_noise[keyIndex];
+    return rng() & 1;
+  }
+  return key_target[keyIndex];
+}
+
+static unsigned events;
+
+static void log_events(uint16_t sample) {
+  while (scancodes_rpos != scancodes_wpos) {
+    const scancode_t *sc = &scancodes[scancodes_rpos];
+    printf("%d: %s %d\n", sample, (sc->flags & KEY_UP_MASK) ? "up" : "down",
+           sc->scancode);
+    scancodes_rpos = SCANCODES_NEXT(scancodes_rpos);
+    ++events;
+  }
+}
+
+static void start(uint8_t period, uint8_t mode) {
+  config.debouncingMode = mode;
+  scan_common_init(period);
+  scan_common_reset();
+  SET_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED);
+}
+
+// Events of one key since the last call, in hand_trace_t format.
+static void take_events(uint8_t keyIndex, uint16_t sample, char *out,
+                        size_t size) {
+  while (scancodes_rpos != scancodes_wpos) {
+    const scancode_t *sc = &scancodes[scancodes_rpos];
+    CHECK(sc->scancode == keyIndex, "key %d fired", sc->scancode);
+    const size_t length = strlen(out);
+    snprintf(out + length, size - length, "%s%c%d", length ? " " : "",
+             (sc->flags & KEY_UP_MASK) ? 'u' : 'd', sample);
+    scancodes_rpos = SCANCODES_NEXT(scancodes_rpos);
+  }
+}
+
+static void run_hand_trace(const hand_trace_t *trace) {
+  printf("%s, period %d\n", trace->name, trace->period);
+  char got[2][128] = {"", ""};
+  start(trace->period, trace->mode);
+  for (uint16_t sample = 0; trace->samples[sample]; sample++) {
+    const bool pressed = trace->samples[sample] == '#';
+    append_debounced(pressed ? 0 : KEY_UP_MASK, HAND_KEY);
+    take_events(HAND_KEY, sample, got[0], sizeof(got[0]));
+    append_debounced_row(HAND_ROW_KEY / MATRIX_COLS,
+                         pressed ? 1UL << (HAND_ROW_KEY % MATRIX_COLS) : 0);
+    take_events(HAND_ROW_KEY, sample, got[1], sizeof(got[1]));
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    printf("%s\n", got[i]);
+    CHECK(strcmp(got[i], trace->events) == 0, "%s, %s: got \"%s\"",
+          trace->name, i ? "row" : "key", got[i]);
+  }
+}
+
+/*
+ * Odd rows go through append_debounced_row like capsense does, even ones key
+ * by key through append_debounced like the other scanners.
+ */
+static void run_trace(uint8_t period, uint8_t mode, bool mixed, uint32_t seed) {
+  printf("period %d mode %d mixed %d seed %u\n", period, mode, mixed, seed);
+  rng_state = seed;
+  for (uint8_t i = 0; i < COMMONSENSE_MATRIX_SIZE; i++) {
+    // 0 - default period.
+    config.debouncing[i] = mixed ? rng() % (MAX_DEBOUNCING_BUFFER_SIZE + 1) : 0;
+    key_target[i] = !NORMALLY_LOW;
+    key_noise[i] = 0;
+  }
+  status_register = 0;
+  start(period, mode);
+  for (uint16_t sample = 0; sample < SAMPLES; sample++) {
+    if (sample == OUTPUT_OFF_FROM) {
+      CLEAR_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED);
+    } else if (sample == OUTPUT_OFF_TO) {
+      SET_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED);
+    }
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      const uint8_t rowStart = row * MATRIX_COLS;
+      uint32_t pressed = 0;
+      for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        if (sample_key(rowStart + col)) {
+          pressed |= 1UL << col;
+        }
+      }
+      if (row & 1) {
+        append_debounced_row(row, pressed);
+        continue;
+      }
+      for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        append_debounced(((pressed >> col) & 1) ? 0 : KEY_UP_MASK,
+                         rowStart + col);
+      }
+    }
+    log_events(sample);
+  }
+  for (uint8_t i = 0; i < COMMONSENSE_MATRIX_SIZE; i++) {
+    printf("key %d: %s, %d bounces\n", i, scan_is_key_down(i) ? "down" : "up",
+           key_bounces[i]);
+  }
+}
+
+int main(void) {
+  for (uint8_t i = 0; i < sizeof(hand_traces) / sizeof(hand_traces[0]); i++) {
+    run_hand_trace(&hand_traces[i]);
+  }
+  for (uint8_t period = 1; period <= MAX_DEBOUNCING_BUFFER_SIZE; period++) {
+    run_trace(period, DEBOUNCING_SYMMETRIC, false, 0x9e3779b9u + period);
+    run_trace(period, DEBOUNCING_EAGER_PRESS, false, 0x7f4a7c15u + period);
+  }
+  run_trace(4, DEBOUNCING_SYMMETRIC, true, 0x85ebca6bu);
+  run_trace(4, DEBOUNCING_EAGER_PRESS, true, 0xc2b2ae35u);
+  // Log has to have something in it for the comparison to mean anything.
+  CHECK(events > 10000, "only %u events", events);
+  return TEST_RESULT();
+}
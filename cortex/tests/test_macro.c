@@ -0,0 +1,193 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+// Macro timing and USBQueue ordering.
+#include "pipeline_harness.h"
+
+// Press macro on 'a': b, 30ms wait, c. Typed keys are held 20ms. Key's own
+// release still goes out.
+static void typed_keys(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, TYPE(2, KC(1)), WAIT(3), TYPE(2, KC(2)));
+  pipeline_start();
+  ticks(5);
+  press(0);
+  run_until(100);
+  EXPECT_SENT("5:+b | 25:-b | 55:+c | 75:-c |");
+  release(0);
+  run_until(110);
+  EXPECT_SENT("100:-a |");
+}
+
+// Press and release on their own, the delay is after the command. Modifier
+// after a key waits for the next report, release or not - one report per
+// pass, so it's 1ms late.
+static void press_release(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, PRESS(3, KC_LEFT_SHIFT), PRESS(2, KC(1)),
+            RELEASE(0, KC(1)), RELEASE(0, KC_LEFT_SHIFT));
+  pipeline_start();
+  press(0);
+  run_until(100);
+  EXPECT_SENT("0:+e1 | 30:+b | 50:-b | 51:-e1 |");
+}
+
+// Release macro plays instead of the release.
+static void release_macro(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), MACRO_TYPE_ONKEYUP, TYPE(2, KC(1)));
+  pipeline_start();
+  press(0);
+  ticks(5);
+  EXPECT_SENT("0:+a |");
+  release(0);
+  run_until(100);
+  EXPECT_SENT("5:+b | 25:-b |");
+}
+
+// Shift goes down before the first character that needs it and up after
+// the last one.
+static void type_string(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, STRING(2, 3), KC(1), KC(2) | MACRO_CHAR_SHIFT,
+            KC(3) | MACRO_CHAR_SHIFT);
+  pipeline_start();
+  press(0);
+  run_until(100);
+  EXPECT_SENT(
+      "0:+b | 20:-b | 21:+e1 21:+c | 40:-c 40:+d | 60:-d | 61:-e1 |");
+}
+
+// Mods stack operations go out between the keys around them.
+static void mods_stack(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, PUSH_MODS(0, 0x02), TYPE(2, KC(1)), POP_MODS(0));
+  pipeline_start();
+  press(0);
+  run_until(100);
+  EXPECT_SENT("0:M0=02 0:+b | 20:-b | 21:M1 |");
+}
+
+// Two macros running at once - events go out in time order, FIFO on ties.
+static void overlapping_macros(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, TYPE(2, KC(2)), TYPE(2, KC(3)));
+  ADD_MACRO(KC(1), 0, TYPE(3, KC(4)), TYPE(2, KC(5)));
+  pipeline_start();
+  press(0);
+  ticks(10);
+  press(1);
+  run_until(100);
+  EXPECT_SENT("0:+c | 10:+e | 20:-c 20:+d | 40:-e 40:-d 40:+f | 60:-f |");
+}
+
+// Real key typed while a macro plays goes out right away, macro events keep
+// their times.
+static void key_during_macro(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, TYPE(2, KC(2)), WAIT(2), TYPE(2, KC(3)));
+  pipeline_start();
+  press(0);
+  ticks(12);
+  press(1);
+  ticks(1);
+  release(1);
+  run_until(100);
+  EXPECT_SENT("0:+c | 12:+b | 13:-b | 20:-c | 40:+d | 60:-d |");
+}
+
+// Players run out - the macro that finds them all busy is dropped and
+// counted, the ones playing are not disturbed. Player is busy until its last
+// command is queued, 40ms here.
+static void busy_players(void) {
+  pipeline_setup();
+  for (uint8_t i = 0; i <= MAX_PLAYING_MACROS; i++) {
+    ADD_MACRO(KC(i), 0, TYPE(2, KC(10 + i)), WAIT(2), TYPE(2, KC(20 + i)));
+  }
+  pipeline_start();
+  for (uint8_t i = 0; i <= MAX_PLAYING_MACROS; i++) {
+    press(i);
+    ticks(1);
+  }
+  run_until(100);
+  EXPECT_SENT("0:+k | 1:+l | 2:+m | 3:+n | 20:-k | 21:-l | 22:-m | 23:-n | "
+              "40:+u | 41:+v | 42:+w | 43:+x | 60:-u | 61:-v | 62:-w | 63:-x |");
+  CHECK(macros_dropped == 1, "%d dropped", macros_dropped);
+}
+
+// Events due when the macro starts carry the trigger's detection stamp, the
+// rest are late on purpose and carry none.
+static void latency_stamps(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(0), 0, TYPE(2, KC(1)));
+  pipeline_start();
+  press(0);
+  const uint32_t detected = scancodes[scancodes_wpos - 1].detected;
+  run_until(100);
+  EXPECT_SENT("0:+b | 20:-b |");
+  CHECK(sent_detected[0] == detected, "press stamp %u", sent_detected[0]);
+  CHECK(sent_detected[1] == 0, "release stamp %u", sent_detected[1]);
+}
+
+// Heap keeps (time, queueing order) under random times; full queue drops
+// new events and counts them.
+static void queue_order(void) {
+  pipeline_setup();
+  pipeline_start();
+  uint32_t rng = 12345;
+  uint8_t due[USBQUEUE_SIZE];
+  for (uint8_t i = 0; i < USBQUEUE_SIZE + 6; i++) {
+    rng = rng * 1103515245 + 12345;
+    const uint8_t time = 10 + (rng >> 16) % 8;
+    if (i < USBQUEUE_SIZE) {
+      due[i] = time;
+    }
+    // Keycode is the queueing order, all releases - no batching limits.
+    queue_usbcode(time, USBQUEUE_RELEASED_MASK, KC(i), 0);
+  }
+  CHECK(USBQueue_length == USBQUEUE_SIZE, "%d queued", USBQueue_length);
+  CHECK(USBQueue_dropped == 6, "%d dropped", USBQueue_dropped);
+  char expected[1024];
+  size_t length = 0;
+  for (uint8_t time = 10; time < 18; time++) {
+    bool any = false;
+    for (uint8_t i = 0; i < USBQUEUE_SIZE; i++) {
+      if (due[i] != time) {
+        continue;
+      }
+      length += snprintf(expected + length, sizeof(expected) - length,
+                         "%s%d:-", length ? " " : "", time);
+      if (KC(i) <= KC(25)) {
+        length += snprintf(expected + length, sizeof(expected) - length, "%c",
+                           'a' + i);
+      } else {
+        length += snprintf(expected + length, sizeof(expected) - length,
+                           "%02x", KC(i));
+      }
+      any = true;
+    }
+    if (any) {
+      length += snprintf(expected + length, sizeof(expected) - length, " |");
+    }
+  }
+  run_until(20);
+  EXPECT_SENT(expected);
+  CHECK(USBQUEUE_IS_EMPTY, "%d left", USBQueue_length);
+}
+
+int main(void) {
+  typed_keys();
+  press_release();
+  release_macro();
+  type_string();
+  mods_stack();
+  overlapping_macros();
+  key_during_macro();
+  latency_stamps();
+  busy_players();
+  queue_order();
+  return TEST_RESULT();
+}
@@ -0,0 +1,177 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Result_ISR key index mapping. Built for 1 and 2 ADCs, odd and even
+ * MATRIX_COLS - see Makefile.
+ * ADCs are simulated at BufMem level, then FinalBuf TD chain recorded by the
+ * DMA stub moves the row into Results - so TD lengths and addresses are
+ * checked too, not just process_row.
+ */
+#include "../scan_common.c"
+#include "../scan_capsense.c"
+#include "test.h"
+
+#define LEVEL_RELEASED 0x10
+#define LEVEL_PRESSED 0xf0
+#define THRESHOLD 0x80
+#define DEBOUNCE 4
+
+/*
+ * What ADC puts into its BufMem block after the initial offset: column,
+ * then grounded sample for every converted channel, top channel first.
+ * Phantom channels are tied to ground.
+ */
+static void convert_row(const uint16_t *levels) {
+  memset(BufMem, 0, sizeof(BufMem));
+  for (uint8_t adc = 0; adc < NUM_ADCs; adc++) {
+    uint16_t *sample = &BufMem[adc * PTK_CHANNELS + ADC_BUF_INITIAL_OFFSET];
+    for (int8_t ch = active_channels - 1; ch >= 0; ch--, sample += 2) {
+      const uint8_t col = adc * ADC_CHANNELS + ch;
+      sample[0] = col < MATRIX_COLS ? levels[col] : 0;
+    }
+  }
+}
+
+// Full address from the low 16 bits DMA has, NULL if it's not in the buffer.
+static uint8_t *dma_address(uint16_t low, void *buffer, size_t size,
+                            uint16_t length) {
+  const uintptr_t base = (uintptr_t)buffer;
+  uintptr_t addr = (base & ~(uintptr_t)0xffff) | low;
+  if (addr < base) {
+    addr += 0x10000;
+  }
+  return addr + length <= base + size ? (uint8_t *)addr : NULL;
+}
+
+// One FinalBuf request: TDs run until one without AUTO_EXEC_NEXT.
+static void move_results(void) {
+  memset(Results, 0xee, sizeof(Results));
+  uint8_t td = stub_initial_td[FinalBuf_DmaHandle];
+  for (uint8_t i = 0; i < NUM_ADCs; i++) {
+    const stub_td_t *t = &stub_td[td];
+    uint8_t *src = dma_address(t->src, BufMem, sizeof(BufMem), t->length);
+    uint8_t *dst = dma_address(t->dst, Results, sizeof(Results), t->length);
+    CHECK(src && dst, "TD %d moves %d bytes out of bounds", td, t->length);
+    if (!src || !dst) {
+      return;
+    }
+    memcpy(dst, src, t->length);
+    if (!(t->config & CY_DMA_TD_AUTO_EXEC_NEXT)) {
+      CHECK(i == NUM_ADCs - 1, "chain ended after %d TDs", i + 1);
+      CHECK(t->config & FinalBuf__TD_TERMOUT_EN, "last TD doesn't raise IRQ");
+      return;
+    }
+    td = t->next;
+  }
+  CHECK(false, "chain runs past %d TDs", NUM_ADCs);
+}
+
+static void read_row(uint8_t row, const uint16_t *levels) {
+  convert_row(levels);
+  move_results();
+  reading_row = row;
+  Result_ISR();
+}
+
+static bool is_scanned(uint8_t col) {
+  return col % ADC_CHANNELS < active_channels;
+}
+
+static void check_monitor(void) {
+  SET_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR);
+  uint16_t levels[MATRIX_COLS];
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      levels[col] = row * MATRIX_COLS + col + 1;
+    }
+    read_row(row, levels);
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      const uint8_t keyIndex = row * MATRIX_COLS + col;
+      CHECK(matrix[keyIndex] == levels[col], "key %d (%d, %d) reads %#x",
+            keyIndex, row, col, matrix[keyIndex]);
+    }
+  }
+  // Monitor leaves readouts in the matrix - C2CMD_GET_MATRIX_STATE resets.
+  CLEAR_BIT(status_register, C2DEVSTATUS_MATRIX_MONITOR);
+  scan_common_reset();
+}
+
+static bool next_event(scancode_t *event) {
+  if (scancodes_rpos == scancodes_wpos) {
+    return false;
+  }
+  *event = scancodes[scancodes_rpos];
+  scancodes_rpos = SCANCODES_NEXT(scancodes_rpos);
+  return true;
+}
+
+// Presses and releases every key on its own, looks at what comes out.
+static void check_keys(void) {
+  uint16_t levels[MATRIX_COLS];
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      const uint8_t keyIndex = row * MATRIX_COLS + col;
+      const bool expected = config.thresholds[keyIndex] != K_IGNORE_KEY;
+      for (uint8_t release = 0; release < 2; release++) {
+        for (uint8_t i = 0; i < MATRIX_COLS; i++) {
+          levels[i] = (i == col && !release) ? LEVEL_PRESSED : LEVEL_RELEASED;
+        }
+        for (uint8_t i = 0; i < DEBOUNCE; i++) {
+          read_row(row, levels);
+        }
+        scancode_t event;
+        if (!expected) {
+          CHECK(!next_event(&event), "ignored key %d sent %d", keyIndex,
+                event.scancode);
+          continue;
+        }
+        CHECK(next_event(&event) && event.scancode == keyIndex &&
+                  event.flags == (release ? KEY_UP_MASK : 0),
+              "key %d (%d, %d) came out as %d/%#x", keyIndex, row, col,
+              event.scancode, event.flags);
+        CHECK(!next_event(&event), "key %d also sent %d", keyIndex,
+              event.scancode);
+      }
+    }
+  }
+}
+
+static void start(void) {
+  stub_tds_allocated = 0;
+  memset(FinalBufTD, CY_DMA_INVALID_TD, sizeof(FinalBufTD));
+  scan_init(DEBOUNCE);
+  scan_common_reset();
+  SET_BIT(status_register, C2DEVSTATUS_OUTPUT_ENABLED);
+}
+
+int main(void) {
+  memset(&config, 0, sizeof(config));
+  memset(config.thresholds, THRESHOLD, sizeof(config.thresholds));
+  start();
+  CHECK(active_channels == ADC_CHANNELS, "%d channels", active_channels);
+  check_monitor();
+  check_keys();
+
+  // Top channel of every ADC and the first row are ignored - shorter chain,
+  // row 0 not driven.
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      if (row == 0 || col % ADC_CHANNELS == ADC_CHANNELS - 1) {
+        config.thresholds[row * MATRIX_COLS + col] = K_IGNORE_KEY;
+      }
+    }
+  }
+  start();
+  CHECK(active_channels == ADC_CHANNELS - 1, "%d channels", active_channels);
+  CHECK(active_row_count == MATRIX_ROWS - 1, "%d rows", active_row_count);
+  for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+    CHECK(is_scanned(col) == (col % ADC_CHANNELS != ADC_CHANNELS - 1),
+          "column %d", col);
+  }
+  check_keys();
+  return TEST_RESULT();
+}
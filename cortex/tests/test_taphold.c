@@ -0,0 +1,177 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Tap-hold on scripted scancode timelines. Keys 'a' and 'b' are tap keys:
+ * tap types 'x' and 'y', hold is the key itself. Other keys are plain.
+ */
+#include "pipeline_harness.h"
+
+#define A 0
+#define B 1
+#define C 2
+
+static void setup(void) {
+  pipeline_setup();
+  ADD_MACRO(KC(A), MACRO_TYPE_TAP, TYPE(2, KC(23)));
+  ADD_MACRO(KC(B), MACRO_TYPE_TAP, TYPE(2, KC(24)));
+  pipeline_start();
+}
+
+static void tap(void) {
+  setup();
+  press(A);
+  run_until(50);
+  EXPECT_SENT("");
+  release(A);
+  run_until(100);
+  EXPECT_SENT("50:+x | 70:-x |");
+}
+
+// Held past the deadline - key goes out as soon as the deadline passes.
+static void hold(void) {
+  setup();
+  press(A);
+  run_until(300);
+  release(A);
+  run_until(310);
+  EXPECT_SENT("201:+a | 300:-a |");
+}
+
+// Release read right at the deadline is still a tap.
+static void release_at_deadline(void) {
+  setup();
+  press(A);
+  run_until(TAP_MS);
+  release(A);
+  run_until(250);
+  EXPECT_SENT("200:+x | 220:-x |");
+}
+
+// Main loop stalled and release came late from the ring - it's a hold,
+// whenever it gets read.
+static void late_release(void) {
+  setup();
+  press(A);
+  ticks(1);
+  systime = 250;
+  release(A);
+  run_until(260);
+  EXPECT_SENT("250:+a | 251:-a |");
+}
+
+// Other key goes down and up while the tap key is down - hold, and that key
+// goes out after it.
+static void permissive_hold(void) {
+  setup();
+  press(A);
+  run_until(10);
+  press(C);
+  run_until(20);
+  release(C);
+  run_until(50);
+  release(A);
+  run_until(60);
+  EXPECT_SENT("20:+a 20:+c | 21:-c | 50:-a |");
+}
+
+// Rolling over: tap key released while the next key is down - tap, and the
+// tap macro goes out before that key.
+static void roll(void) {
+  setup();
+  press(A);
+  run_until(10);
+  press(C);
+  run_until(20);
+  release(A);
+  run_until(60);
+  release(C);
+  run_until(70);
+  EXPECT_SENT("20:+x | 21:+c | 40:-x | 60:-c |");
+}
+
+// Home row roll over two tap keys - both are taps, in order, each with its
+// own deadline.
+static void two_taps(void) {
+  setup();
+  press(A);
+  run_until(10);
+  press(B);
+  run_until(20);
+  release(A);
+  run_until(30);
+  release(B);
+  run_until(100);
+  EXPECT_SENT("20:+x | 30:+y | 40:-x | 50:-y |");
+}
+
+// Second tap key tapped while the first is held - first is a hold, second
+// is a tap.
+static void hold_then_tap(void) {
+  setup();
+  press(A);
+  run_until(10);
+  press(B);
+  run_until(30);
+  release(B);
+  run_until(50);
+  release(A);
+  run_until(60);
+  EXPECT_SENT("30:+a | 31:+y | 50:-y 50:-a |");
+}
+
+// Second tap key's deadline counts from its own press, not from when the
+// first one resolved.
+static void second_deadline(void) {
+  setup();
+  press(A);
+  run_until(100);
+  press(B);
+  run_until(150);
+  release(A);
+  run_until(400);
+  EXPECT_SENT("150:+x | 170:-x | 301:+b |");
+}
+
+// More keys than tap_buffer holds come in while the tap key is down - it
+// resolves as a hold, nothing gets lost.
+static void buffer_full(void) {
+  setup();
+  press(A);
+  for (uint8_t i = 0; i < 16; i++) {
+    ticks(1);
+    press(C + i);
+  }
+  run_until(30);
+  EXPECT_SENT("15:+a 15:+c 15:+d 15:+e 15:+f 15:+g 15:+h 15:+i 15:+j 15:+k "
+              "15:+l 15:+m 15:+n 15:+o 15:+p 15:+q | 16:+r |");
+}
+
+// Everything arrives in one burst, before the main loop sees any of it.
+static void burst(void) {
+  setup();
+  press(A);
+  press(C);
+  release(C);
+  release(A);
+  run_until(50);
+  EXPECT_SENT("2:+a 2:+c | 3:-c 3:-a |");
+}
+
+int main(void) {
+  tap();
+  hold();
+  release_at_deadline();
+  late_release();
+  permissive_hold();
+  roll();
+  two_taps();
+  hold_then_tap();
+  second_deadline();
+  buffer_full();
+  burst();
+  return TEST_RESULT();
+}